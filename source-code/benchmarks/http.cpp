@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <selx/http.hpp>
+
+using namespace selx::http;
+
+namespace {
+
+    const char* REQUEST =
+        "GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg HTTP/1.1\r\n"
+        "Host: www.kittyhell.com\r\n"
+        "User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10_6_8; ja-JP-mac; rv:1.9.2.3) "
+        "Gecko/20100401 Firefox/3.6.3 Pathtraq/0.9\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+        "Accept-Encoding: gzip,deflate\r\n"
+        "Accept-Charset: Shift_JIS,utf-8;q=0.7,*;q=0.7\r\n"
+        "Keep-Alive: 115\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: wp_ozh_wsa_visits=2; wp_ozh_wsa_visit_lasttime=xxxxxxxxxx; "
+        "__utma=xxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.x; "
+        "__utmz=xxxxxxxxx.xxxxxxxxxx.x.x.utmccn=(referral)|utmcsr=reader.livedoor.com|utmcct=/reader/|utmcmd=referral\r\n"
+        "\r\n";
+
+    // Feeds `buffer` to a parser in slices of `sliceLength` bytes, `rounds`
+    // times, and prints the throughput.
+    void measure(const char* name, std::string buffer, std::size_t sliceLength, std::size_t rounds)
+    {
+        Parser parser;
+        std::size_t requestsCount = 0;
+        std::size_t headersCount = 0;
+
+        auto handleRequest = [&](const Request& request)
+        {
+            requestsCount++;
+            headersCount += request.headers.size();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (std::size_t round = 0; round < rounds; round++)
+        {
+            for (std::size_t offset = 0; offset < buffer.size(); offset += sliceLength)
+            {
+                std::size_t length = std::min(sliceLength, buffer.size() - offset);
+
+                parser.feed(&buffer[offset], length, handleRequest);
+            }
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double bytes = (double) buffer.size() * (double) rounds;
+
+        std::printf(
+            "%-24s %10.0f requests/s %10.1f MiB/s (%zu headers)\n",
+            name,
+            (double) requestsCount / elapsed.count(),
+            bytes / (1024.0 * 1024.0) / elapsed.count(),
+            headersCount
+        );
+    }
+
+}
+
+int main()
+{
+    std::string single = REQUEST;
+    std::string pipelined;
+    // Long header lines, as with large cookies or tokens, are where wider
+    // scanning pays off the most.
+    std::string large = std::string("GET / HTTP/1.1\r\nHost: localhost\r\nCookie: ") +
+        std::string(4096, 'x') + "\r\n\r\n";
+
+    for (int i = 0; i < 64; i++)
+    {
+        pipelined += REQUEST;
+    }
+
+    std::pair<Scanner, const char*> scanners[] = {
+        { Scanner::Scalar, "scalar" },
+        { Scanner::SSE2, "sse2" },
+        { Scanner::AVX2, "avx2" },
+    };
+
+    for (const auto& [scanner, scannerName] : scanners)
+    {
+        if (!useScanner(scanner))
+        {
+            std::printf("%s: unsupported\n\n", scannerName);
+            continue;
+        }
+
+        std::printf("%s:\n", scannerName);
+
+        measure("whole", single, single.size(), 1000000);
+        measure("fragmented (1028 bytes)", pipelined, 1028, 20000);
+        measure("fragmented (16 bytes)", single, 16, 200000);
+        measure("pipelined", pipelined, pipelined.size(), 20000);
+        measure("large headers", large, large.size(), 200000);
+
+        std::printf("\n");
+    }
+
+    return 0;
+}
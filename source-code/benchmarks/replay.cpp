@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <selx/replay.hpp>
+
+using namespace selx::replay;
+
+namespace {
+
+    const std::uint16_t PORT = 47000;
+
+    // Builds a trace with the traffic shapes that hurt the most in
+    // production, when no recorded trace is given.
+    Trace synthesize()
+    {
+        Trace trace = {};
+        std::uint64_t time = 0;
+        std::uint32_t peer = 0;
+
+        auto add = [&](Event::Kind kind, std::uint32_t target, std::string data)
+        {
+            trace.events.push_back(Event { kind, time, target, std::move(data) });
+        };
+
+        add(Event::Kind::Phase, 0, "mass reconnect");
+
+        for (int round = 0; round < 4; round++)
+        {
+            std::uint32_t first = peer;
+
+            for (int i = 0; i < 250; i++)
+            {
+                add(Event::Kind::Connection, peer++, {});
+            }
+
+            time += 10000000;
+
+            for (std::uint32_t i = first; i < peer; i++)
+            {
+                add(Event::Kind::Disconnection, i, {});
+            }
+
+            time += 10000000;
+        }
+
+        add(Event::Kind::Phase, 0, "slowloris");
+
+        std::uint32_t first = peer;
+
+        for (int i = 0; i < 200; i++)
+        {
+            add(Event::Kind::Connection, peer++, {});
+        }
+
+        for (int round = 0; round < 20; round++)
+        {
+            time += 5000000;
+
+            for (std::uint32_t i = first; i < peer; i++)
+            {
+                add(Event::Kind::Data, i, "x");
+            }
+        }
+
+        for (std::uint32_t i = first; i < peer; i++)
+        {
+            add(Event::Kind::Disconnection, i, {});
+        }
+
+        add(Event::Kind::Phase, 0, "bursty fan-in");
+
+        first = peer;
+
+        for (int i = 0; i < 100; i++)
+        {
+            add(Event::Kind::Connection, peer++, {});
+        }
+
+        for (int burst = 0; burst < 5; burst++)
+        {
+            time += 20000000;
+
+            for (int fragment = 0; fragment < 16; fragment++)
+            {
+                for (std::uint32_t i = first; i < peer; i++)
+                {
+                    add(Event::Kind::Data, i, std::string(4096, 'y'));
+                }
+            }
+        }
+
+        for (std::uint32_t i = first; i < peer; i++)
+        {
+            add(Event::Kind::Disconnection, i, {});
+        }
+
+        return trace;
+    }
+
+}
+
+int main(int argc, char** argv)
+{
+    Player::Transport transport = Player::Transport::SocketPair;
+    Player::Speed speed = Player::Speed::Maximum;
+    Trace trace = {};
+
+    if ((argc > 1) && (0 == std::strcmp(argv[1], "loopback")))
+    {
+        transport = Player::Transport::Loopback;
+    }
+
+    if ((argc > 2) && (0 == std::strcmp(argv[2], "realtime")))
+    {
+        speed = Player::Speed::Realtime;
+    }
+
+    if (argc > 3)
+    {
+        std::ifstream stream(argv[3], std::ios::binary);
+
+        trace = Trace::load(stream);
+    }
+    else
+    {
+        trace = synthesize();
+    }
+
+    Player player(trace, transport, speed, PORT);
+
+    selx::Server::Handlers handlers = {};
+
+    handlers.handlePeerConnection = [](selx::Server*, selx::Server::Socket) {};
+    handlers.handlePeerDisconnection = [](selx::Server*, selx::Server::Socket) {};
+    handlers.handleDataArrival = [](selx::Server*, selx::Server::Socket, char*, std::size_t) {};
+
+    selx::Server server = selx::Server::listen(PORT, player.wrap(handlers));
+
+    Report report = player.play(server);
+
+    std::printf(
+        "%-16s %8s %8s %8s %8s %12s %12s %10s %10s %10s\n",
+        "phase", "seconds", "accepts", "reads", "closes",
+        "MiB/s", "events/s", "p50 us", "p99 us", "max us"
+    );
+
+    for (const Phase& phase : report.phases)
+    {
+        std::printf(
+            "%-16s %8.3f %8zu %8zu %8zu %12.1f %12.0f %10.1f %10.1f %10.1f\n",
+            phase.name.c_str(),
+            phase.seconds,
+            phase.connections,
+            phase.fragments,
+            phase.disconnections,
+            phase.bytesPerSecond / (1024.0 * 1024.0),
+            phase.eventsPerSecond,
+            phase.latencyMedian,
+            phase.latency99,
+            phase.latencyMaximum
+        );
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "balancer.hpp"
+
+using namespace selx::epoll;
+
+Balancer::Balancer(
+    std::vector<Server*> servers,
+    double threshold,
+    std::size_t migrationsCount
+)
+{
+    this->servers = servers;
+    this->threshold = threshold;
+    this->migrationsCount = migrationsCount;
+    this->loads = {};
+
+    for (Server* server : this->servers)
+    {
+        this->loads.push_back(server->load());
+    }
+}
+
+void Balancer::rebalance()
+{
+    if (this->servers.size() < 2)
+    {
+        return;
+    }
+
+    std::size_t busiestIndex = 0;
+    std::size_t idlestIndex = 0;
+    std::uint64_t busiestEvents = 0;
+    std::uint64_t idlestEvents = UINT64_MAX;
+    std::uint64_t totalEvents = 0;
+
+    for (std::size_t i = 0; i < this->servers.size(); i++)
+    {
+        Server::Statistics load = this->servers[i]->load();
+        std::uint64_t events = load.events - this->loads[i].events;
+
+        this->loads[i] = load;
+        totalEvents += events;
+
+        if (events > busiestEvents)
+        {
+            busiestIndex = i;
+            busiestEvents = events;
+        }
+
+        if (events < idlestEvents)
+        {
+            idlestIndex = i;
+            idlestEvents = events;
+        }
+    }
+
+    double averageEvents = (double) totalEvents / (double) this->servers.size();
+
+    if (
+        (busiestIndex == idlestIndex) ||
+        ((double) busiestEvents <= averageEvents * (1.0 + this->threshold))
+    )
+    {
+        return;
+    }
+
+    // NOTE: Servers only know the load of their peers since they last
+    // migrated some, so the budget is handed over as a share of it.
+    double share = (double) (busiestEvents - idlestEvents) / 2.0 / (double) busiestEvents;
+
+    this->servers[busiestIndex]->migrate(this->migrationsCount, this->servers[idlestIndex], share);
+}
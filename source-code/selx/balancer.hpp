@@ -0,0 +1,39 @@
+#ifndef SELX_BALANCER_HPP
+#define SELX_BALANCER_HPP
+
+#include <cstdint>
+#include <vector>
+#include "epoll.hpp"
+
+namespace selx::epoll {
+
+    class Balancer {
+
+        public:
+
+            Balancer(
+                std::vector<Server*> servers,
+                double threshold = 0.25,
+                std::size_t migrationsCount = 16
+            );
+
+            // Compares how many reads each server issued since the previous
+            // call. If the busiest one exceeds the average by more than the
+            // threshold, it is asked to move its hottest peers to the idlest
+            // one, up to half the gap between both so that the load does not
+            // just swap sides. Safe to call from any thread, but not from
+            // several threads at once.
+            void rebalance();
+
+        private:
+
+            std::vector<Server*>                servers;
+            double                              threshold;
+            std::size_t                         migrationsCount;
+            std::vector<Server::Statistics>     loads;
+
+    };
+
+}
+
+#endif // SELX_BALANCER_HPP
@@ -1,232 +1,1290 @@
 #include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <random>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include "epoll.hpp"
 
 using namespace selx::epoll;
 
+namespace {
+
+    // Set in the epoll data of listeners, whose lower bits hold the listener
+    // index instead of a descriptor. Peers store their descriptor, which never
+    // reaches this bit.
+    const std::uint64_t LISTENER_TAG = std::uint64_t(1) << 32;
+
+    // NOTE: Random per process, so attackers cannot pick addresses that share
+    // a slot with their victims. It is not per server, so that hashes stay
+    // valid when peers migrate.
+    const std::uint64_t SOURCE_SEED =
+        ((std::uint64_t) std::random_device()() << 32) | std::random_device()();
+
+    // Hashes the address (but not the port) of a peer. IPv4-mapped addresses
+    // hash like plain IPv4 ones, so dual-stack listeners count them together.
+    std::uint64_t hashSource(const sockaddr_storage& osAddress)
+    {
+        const unsigned char* bytes = nullptr;
+        std::size_t bytesLength = 0;
+
+        if (AF_INET == osAddress.ss_family)
+        {
+            bytes = (const unsigned char*) &((const sockaddr_in*) &osAddress)->sin_addr;
+            bytesLength = 4;
+        }
+        else if (AF_INET6 == osAddress.ss_family)
+        {
+            const in6_addr* osAddressIPv6 = &((const sockaddr_in6*) &osAddress)->sin6_addr;
+
+            bytes = (const unsigned char*) osAddressIPv6;
+            bytesLength = 16;
+
+            if (IN6_IS_ADDR_V4MAPPED(osAddressIPv6))
+            {
+                bytes += 12;
+                bytesLength = 4;
+            }
+        }
+        else
+        {
+            return 0;
+        }
+
+        std::uint64_t hash = SOURCE_SEED;
+
+        for (std::size_t i = 0; i < bytesLength; i++)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3;
+        }
+
+        // Finalizer from SplitMix64, so that the low bits (which pick the
+        // slot) depend on every byte.
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EB;
+        hash = hash ^ (hash >> 31);
+
+        return (0 == hash) ? 1 : hash;
+    }
+
+    // Whether the file at a local endpoint's path is a socket left behind by
+    // a server that is gone, i.e. one that refuses connections.
+    bool stale(const std::string& path, const sockaddr* osAddress, socklen_t osAddressLength)
+    {
+        struct stat osStatus = {};
+
+        if ((-1 == ::lstat(path.c_str(), &osStatus)) || (!S_ISSOCK(osStatus.st_mode)))
+        {
+            return false;
+        }
+
+        int osProbeSocket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+        if (-1 == osProbeSocket)
+        {
+            return false;
+        }
+
+        bool refused = (-1 == ::connect(osProbeSocket, osAddress, osAddressLength)) &&
+            (ECONNREFUSED == errno);
+
+        ::close(osProbeSocket);
+
+        return refused;
+    }
+
+    // Size of a bucket, one second worth of its rate by default. Anything
+    // costs at least one token, so a smaller bucket could never pay for it.
+    double capacity(double rate, double burst)
+    {
+        return std::max(1.0, (0 < burst) ? burst : rate);
+    }
+
+    // Adds the tokens earned since the last refill, up to the burst.
+    double refill(
+        double tokens,
+        double rate,
+        double burst,
+        std::chrono::steady_clock::duration elapsed
+    )
+    {
+        return std::min(burst, tokens + rate * std::chrono::duration<double>(elapsed).count());
+    }
+
+    bool equals(const Server::Endpoint& left, const Server::Endpoint& right)
+    {
+        return (left.family == right.family) &&
+            (left.port == right.port) &&
+            (left.path == right.path) &&
+            (left.abstract == right.abstract) &&
+            (left.shared == right.shared);
+    }
+
+}
+
+Server::Endpoint Server::Endpoint::ipv4(std::uint16_t port, bool shared)
+{
+    return Server::Endpoint { Server::Endpoint::Family::IPv4, port, {}, false, shared };
+}
+
+Server::Endpoint Server::Endpoint::ipv6(std::uint16_t port, bool shared)
+{
+    return Server::Endpoint { Server::Endpoint::Family::IPv6, port, {}, false, shared };
+}
+
+Server::Endpoint Server::Endpoint::local(std::string path)
+{
+    return Server::Endpoint { Server::Endpoint::Family::Local, 0, path, false, false };
+}
+
+Server::Endpoint Server::Endpoint::abstractLocal(std::string name)
+{
+    return Server::Endpoint { Server::Endpoint::Family::Local, 0, name, true, false };
+}
+
 Server::~Server()
 {
-    for (Server::Socket osPeerSocket : this->osPeersSockets)
+    // NOTE: Moved-from servers no longer own any descriptor.
+    if (!this->mailbox)
+    {
+        return;
+    }
+
+    for (const auto& [osPeerSocket, context] : this->mailbox->attachments)
+    {
+        ::close(osPeerSocket);
+    }
+
+    for (const auto& [osPeerSocket, peer] : this->osPeers)
+    {
+        ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, osPeerSocket, NULL);
+        ::close(osPeerSocket);
+    }
+
+    for (const Server::Listener& osListener : this->osListeners)
+    {
+        ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, osListener.osSocket, NULL);
+
+        Server::release(osListener);
+    }
+
+    ::close(this->osEpollDescriptor);
+}
+
+Server Server::listen(std::uint16_t port, Server::Handlers handlers)
+{
+    return Server::listen({ Server::Endpoint::ipv4(port) }, handlers);
+}
+
+Server Server::listen(std::vector<Server::Endpoint> endpoints, Server::Handlers handlers)
+{
+    int osEpollDescriptor = ::epoll_create1(0);
+
+    if (-1 == osEpollDescriptor)
+    {
+        throw Server::Errors::OpenEpoll();
+    }
+
+    std::vector<Server::Listener> osListeners = {};
+
+    try
+    {
+        for (const Server::Endpoint& endpoint : endpoints)
+        {
+            osListeners.push_back(Server::Listener { Server::open(endpoint), endpoint });
+
+            epoll_event osEpollEvent = {};
+
+            osEpollEvent.data.u64 = LISTENER_TAG | (osListeners.size() - 1);
+            osEpollEvent.events = EPOLLIN | EPOLLERR;
+
+            if (-1 == ::epoll_ctl(
+                osEpollDescriptor, EPOLL_CTL_ADD, osListeners.back().osSocket, &osEpollEvent
+            ))
+            {
+                throw Server::Errors::AttachEpoll();
+            }
+        }
+    }
+    catch (...)
+    {
+        // Otherwise the endpoints opened so far would stay bound, and a retry
+        // would fail with `EADDRINUSE`.
+        for (const Server::Listener& osListener : osListeners)
+        {
+            Server::release(osListener);
+        }
+
+        ::close(osEpollDescriptor);
+
+        throw;
+    }
+
+    return Server(osListeners, osEpollDescriptor, handlers);
+}
+
+void Server::poll()
+{
+    if (this->mailbox->pending.load(std::memory_order_acquire))
+    {
+        this->collect();
+    }
+
+    if (!this->osPausedPeers.empty())
+    {
+        this->resume();
+    }
+
+    int osEpollEventsCount = ::epoll_wait(
+        this->osEpollDescriptor,
+        this->osEpollEvents.data(),
+        (int) this->osEpollEvents.size(),
+        0
+    );
+
+    if (-1 == osEpollEventsCount)
+    {
+        throw Server::Errors::WaitEpoll();
+    }
+
+    std::size_t acceptsCount = 0;
+    std::size_t bytesCount = 0;
+    std::size_t readsCount = 0;
+    bool timed = (std::chrono::microseconds::zero() != this->policy.timeBudget);
+    auto deadline = std::chrono::steady_clock::now() + this->policy.timeBudget;
+
+    auto late = [&]()
+    {
+        return timed && (std::chrono::steady_clock::now() >= deadline);
+    };
+
+    auto exhausted = [&]()
+    {
+        return (bytesCount >= this->policy.bytesBudget) || late();
+    };
+
+    auto acceptPending = [&]()
+    {
+        for (int i = 0; i < osEpollEventsCount; i++)
+        {
+            if (0 == (this->osEpollEvents[i].data.u64 & LISTENER_TAG))
+            {
+                continue;
+            }
+
+            if (this->osEpollEvents[i].events & EPOLLERR)
+            {
+                throw Server::Errors::BrokenListener();
+            }
+
+            std::size_t listenerIndex = this->osEpollEvents[i].data.u64 & ~LISTENER_TAG;
+
+            // Drain the backlog, since the listener would otherwise be
+            // reported again (and cost another `epoll_wait`) per connection.
+            // NOTE: Accepting reads no bytes, so a busy reader spending the
+            // bytes budget every `poll` must not starve new connections.
+            while (
+                (this->osEpollEvents[i].events & EPOLLIN) &&
+                (acceptsCount < this->policy.acceptsBudget) &&
+                (!late()) &&
+                (this->accept(listenerIndex))
+            )
+            {
+                acceptsCount++;
+            }
+        }
+    };
+
+    auto readPeer = [&](const epoll_event& osEpollEvent)
+    {
+        Server::Socket osPeerSocket = osEpollEvent.data.fd;
+
+        // The peer may have been kicked by a handler earlier in this batch.
+        if (0 == this->osPeers.count(osPeerSocket))
+        {
+            return;
+        }
+
+        if (exhausted())
+        {
+            this->osDeferredPeers.insert(osPeerSocket);
+            return;
+        }
+
+        if (osEpollEvent.events & EPOLLERR)
+        {
+            throw Server::Errors::BrokenPeer();
+        }
+
+        if (osEpollEvent.events & EPOLLOUT)
+        {
+            this->flush(osPeerSocket);
+        }
+
+        if (0 == (osEpollEvent.events & (EPOLLIN | EPOLLHUP)))
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < this->policy.readsPerPeer; i++)
+        {
+            std::size_t bufferLength = this->read(osPeerSocket);
+
+            bytesCount += bufferLength;
+            readsCount++;
+
+            // NOTE: A short read means the socket has been drained (or
+            // closed), so reading again would only return `EAGAIN`. The
+            // handler may also have kicked or detached the peer.
+            if (
+                (bufferLength < 1028) ||
+                (0 == this->osPeers.count(osPeerSocket)) ||
+                (exhausted())
+            )
+            {
+                break;
+            }
+        }
+    };
+
+    auto readPeers = [&]()
+    {
+        // Peers left over by the previous `poll` are served first, otherwise
+        // they could be skipped again by the same budget.
+        std::unordered_set<Server::Socket> osDeferredPeers = {};
+
+        std::swap(osDeferredPeers, this->osDeferredPeers);
+
+        if (!osDeferredPeers.empty())
+        {
+            for (int i = 0; i < osEpollEventsCount; i++)
+            {
+                if (
+                    (0 == (this->osEpollEvents[i].data.u64 & LISTENER_TAG)) &&
+                    (0 != osDeferredPeers.count(this->osEpollEvents[i].data.fd))
+                )
+                {
+                    readPeer(this->osEpollEvents[i]);
+                }
+            }
+        }
+
+        for (int i = 0; i < osEpollEventsCount; i++)
+        {
+            if (
+                (0 == (this->osEpollEvents[i].data.u64 & LISTENER_TAG)) &&
+                (0 == osDeferredPeers.count(this->osEpollEvents[i].data.fd))
+            )
+            {
+                readPeer(this->osEpollEvents[i]);
+            }
+        }
+
+        if (!osDeferredPeers.empty())
+        {
+            // Deferred peers missing from this batch (e.g. because it was
+            // smaller than the ready list) keep their turn for the next one.
+            for (int i = 0; i < osEpollEventsCount; i++)
+            {
+                if (0 == (this->osEpollEvents[i].data.u64 & LISTENER_TAG))
+                {
+                    osDeferredPeers.erase(this->osEpollEvents[i].data.fd);
+                }
+            }
+
+            for (Server::Socket osPeerSocket : osDeferredPeers)
+            {
+                if (0 != this->osPeers.count(osPeerSocket))
+                {
+                    this->osDeferredPeers.insert(osPeerSocket);
+                }
+            }
+        }
+    };
+
+    if (Server::Policy::Priority::Accepts == this->policy.priority)
+    {
+        acceptPending();
+        readPeers();
+    }
+    else
+    {
+        readPeers();
+        acceptPending();
+    }
+
+    this->mailbox->bytes.fetch_add(bytesCount, std::memory_order_relaxed);
+    this->mailbox->events.fetch_add(readsCount, std::memory_order_relaxed);
+
+    // A full batch means more events were probably left in the kernel, while
+    // a mostly empty one wastes memory that is walked on every call.
+    std::size_t osEpollEventsLength = this->osEpollEvents.size();
+
+    if ((std::size_t) osEpollEventsCount == osEpollEventsLength)
+    {
+        this->osEpollEvents.resize(std::min(osEpollEventsLength * 2, this->policy.maximumEvents));
+    }
+    else if ((std::size_t) osEpollEventsCount < osEpollEventsLength / 4)
+    {
+        this->osEpollEvents.resize(std::max(osEpollEventsLength / 2, this->policy.minimumEvents));
+    }
+}
+
+void Server::send(Server::Socket osPeerSocket, char* buffer, std::size_t bufferLength)
+{
+    auto iterator = this->osPeers.find(osPeerSocket);
+
+    // NOTE: Queued output is only bounded by the policy, so a peer that stops
+    // reading must not be able to grow it forever.
+    auto overflows = [&](std::size_t queuedLength)
+    {
+        return (0 != this->policy.maximumOutput) &&
+            (iterator->second.output.size() + queuedLength > this->policy.maximumOutput);
+    };
+
+    // Keep the order of the output if earlier bytes are still queued.
+    if ((std::end(this->osPeers) != iterator) && (!iterator->second.output.empty()))
+    {
+        if (overflows(bufferLength))
+        {
+            this->kick(osPeerSocket);
+            return;
+        }
+
+        iterator->second.output.append(buffer, bufferLength);
+        return;
+    }
+
+    // NOTE: Without `MSG_NOSIGNAL`, writing to a reset peer raises `SIGPIPE`,
+    // which kills the whole process.
+    ssize_t sentLength = ::send(osPeerSocket, (void*) buffer, bufferLength, MSG_NOSIGNAL);
+
+    if (-1 == sentLength)
+    {
+        if (
+            (std::end(this->osPeers) == iterator) ||
+            ((EAGAIN != errno) && (EWOULDBLOCK != errno))
+        )
+        {
+            throw Server::Errors::WriteSocket();
+        }
+
+        sentLength = 0;
+    }
+
+    if ((std::end(this->osPeers) != iterator) && ((std::size_t) sentLength < bufferLength))
+    {
+        if (overflows(bufferLength - sentLength))
+        {
+            this->kick(osPeerSocket);
+            return;
+        }
+
+        // The socket buffer is full, so the rest is written once the peer is
+        // reported as writable.
+        iterator->second.output.append(buffer + sentLength, bufferLength - sentLength);
+
+        this->watch(osPeerSocket);
+    }
+}
+
+void Server::kick(Server::Socket osPeerSocket)
+{
+    auto iterator = this->osPeers.find(osPeerSocket);
+
+    if (std::end(this->osPeers) != iterator)
+    {
+        this->dismiss(iterator->second);
+        this->osPeers.erase(iterator);
+    }
+
+    this->osDeferredPeers.erase(osPeerSocket);
+
+    if (-1 == ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, osPeerSocket, NULL))
+    {
+        throw Server::Errors::DetachEpoll();
+    }
+
+    if (-1 == ::close(osPeerSocket))
+    {
+        throw Server::Errors::CloseSocket();
+    }
+    else
+    {
+        this->handlers.handlePeerDisconnection(this, osPeerSocket);
+    }
+}
+
+Server::Context Server::detach(Server::Socket osPeerSocket)
+{
+    auto iterator = this->osPeers.find(osPeerSocket);
+
+    if (std::end(this->osPeers) == iterator)
+    {
+        throw Server::Errors::UnknownPeer();
+    }
+
+    if (-1 == ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, osPeerSocket, NULL))
+    {
+        throw Server::Errors::DetachEpoll();
+    }
+
+    Server::Peer& peer = iterator->second;
+    Server::Context context = {};
+
+    if (SIZE_MAX != peer.listenerIndex)
+    {
+        context.origin = this->osListeners[peer.listenerIndex].endpoint;
+    }
+
+    context.source = peer.source;
+    context.output = std::move(peer.output);
+    context.statistics = peer.statistics;
+    context.bytesTokens = peer.bytesTokens;
+    context.messagesTokens = peer.messagesTokens;
+    context.refilledAt = peer.refilledAt;
+    context.paused = peer.paused;
+    context.resumeAt = peer.resumeAt;
+
+    this->dismiss(peer);
+    this->osPeers.erase(iterator);
+    this->osDeferredPeers.erase(osPeerSocket);
+
+    if (this->handlers.handlePeerDetachment)
+    {
+        context.payload = this->handlers.handlePeerDetachment(this, osPeerSocket);
+    }
+
+    return context;
+}
+
+void Server::attach(Server::Socket osPeerSocket, Server::Context context)
+{
+    std::lock_guard<std::mutex> lock(this->mailbox->mutex);
+
+    this->mailbox->attachments.emplace_back(osPeerSocket, std::move(context));
+    this->mailbox->pending.store(true, std::memory_order_release);
+}
+
+void Server::migrate(std::size_t count, Server* target, double share)
+{
+    std::lock_guard<std::mutex> lock(this->mailbox->mutex);
+
+    this->mailbox->migrations.push_back(Server::Migration { count, target, share });
+    this->mailbox->pending.store(true, std::memory_order_release);
+}
+
+const Server::Statistics& Server::statistics(Server::Socket osPeerSocket) const
+{
+    auto iterator = this->osPeers.find(osPeerSocket);
+
+    if (std::end(this->osPeers) == iterator)
+    {
+        throw Server::Errors::UnknownPeer();
+    }
+
+    return iterator->second.statistics;
+}
+
+Server::Statistics Server::load() const
+{
+    return Server::Statistics {
+        this->mailbox->bytes.load(std::memory_order_relaxed),
+        this->mailbox->events.load(std::memory_order_relaxed),
+    };
+}
+
+void Server::configure(Server::Policy policy)
+{
+    policy.minimumEvents = std::max<std::size_t>(policy.minimumEvents, 1);
+    policy.maximumEvents = std::max(policy.maximumEvents, policy.minimumEvents);
+    policy.readsPerPeer = std::max<std::size_t>(policy.readsPerPeer, 1);
+
+    this->policy = policy;
+    this->osEpollEvents.resize(std::clamp(
+        this->osEpollEvents.size(), policy.minimumEvents, policy.maximumEvents
+    ));
+}
+
+void Server::limit(Server::Limits limits)
+{
+    limits.sourceSlots = std::max<std::size_t>(limits.sourceSlots, 1);
+    limits.acceptsBurst = capacity(limits.acceptsPerSecond, limits.acceptsBurst);
+    limits.bytesBurst = capacity(limits.bytesPerSecond, limits.bytesBurst);
+    limits.messagesBurst = capacity(limits.messagesPerSecond, limits.messagesBurst);
+
+    this->limits = limits;
+    this->acceptsBucket = Server::Bucket { limits.acceptsBurst, Server::Clock::now() };
+    this->sourceConnections.assign(limits.sourceSlots, 0);
+
+    for (auto& [osPeerSocket, peer] : this->osPeers)
+    {
+        if (0 != peer.source)
+        {
+            this->sourceConnections[peer.source % limits.sourceSlots]++;
+        }
+
+        peer.bytesTokens = limits.bytesBurst;
+        peer.messagesTokens = limits.messagesBurst;
+        peer.refilledAt = this->acceptsBucket.refilledAt;
+    }
+}
+
+void Server::adopt(Server::Socket osPeerSocket)
+{
+    this->admit(osPeerSocket, SIZE_MAX, 0);
+}
+
+const Server::Endpoint& Server::origin(Server::Socket osPeerSocket) const
+{
+    auto iterator = this->osPeers.find(osPeerSocket);
+
+    if ((std::end(this->osPeers) == iterator) || (SIZE_MAX == iterator->second.listenerIndex))
+    {
+        throw Server::Errors::UnknownPeer();
+    }
+
+    return this->osListeners[iterator->second.listenerIndex].endpoint;
+}
+
+Server::Server(
+    std::vector<Server::Listener> osListeners,
+    int osEpollDescriptor,
+    Server::Handlers handlers
+)
+{
+    this->osListeners = osListeners;
+    this->osEpollDescriptor = osEpollDescriptor;
+    this->osEpollEvents = std::vector<epoll_event>(128);
+    this->osPeers = {};
+    this->osDeferredPeers = {};
+    this->handlers = handlers;
+    this->policy = {};
+    this->limits = {};
+    this->sourceConnections = std::vector<std::uint32_t>(this->limits.sourceSlots);
+    this->acceptsBucket = {};
+    this->osPausedPeers = {};
+    this->mailbox = std::make_unique<Server::Mailbox>();
+    this->mailbox->pending = false;
+    this->mailbox->bytes = 0;
+    this->mailbox->events = 0;
+}
+
+Server::Socket Server::open(const Server::Endpoint& endpoint)
+{
+    sockaddr_storage osAddress = {};
+    socklen_t osAddressLength = {};
+    int osProtocol = {};
+
+    if (Server::Endpoint::Family::IPv4 == endpoint.family)
+    {
+        sockaddr_in* osAddressIPv4 = (sockaddr_in*) &osAddress;
+
+        osAddressIPv4->sin_family = AF_INET;
+        osAddressIPv4->sin_addr.s_addr = INADDR_ANY;
+        osAddressIPv4->sin_port = ::htons(endpoint.port);
+
+        osAddressLength = sizeof(sockaddr_in);
+        osProtocol = IPPROTO_TCP;
+    }
+    else if (Server::Endpoint::Family::IPv6 == endpoint.family)
+    {
+        sockaddr_in6* osAddressIPv6 = (sockaddr_in6*) &osAddress;
+
+        osAddressIPv6->sin6_family = AF_INET6;
+        osAddressIPv6->sin6_addr = in6addr_any;
+        osAddressIPv6->sin6_port = ::htons(endpoint.port);
+
+        osAddressLength = sizeof(sockaddr_in6);
+        osProtocol = IPPROTO_TCP;
+    }
+    else
+    {
+        sockaddr_un* osAddressLocal = (sockaddr_un*) &osAddress;
+
+        // NOTE: Abstract names start with a null byte, which is not counted
+        // as a terminator, so they get one byte less than filesystem paths.
+        if (endpoint.path.size() + 1 > sizeof(osAddressLocal->sun_path))
+        {
+            throw Server::Errors::BindSocket();
+        }
+
+        osAddressLocal->sun_family = AF_UNIX;
+
+        if (endpoint.abstract)
+        {
+            std::memcpy(&osAddressLocal->sun_path[1], endpoint.path.data(), endpoint.path.size());
+
+            osAddressLength = offsetof(sockaddr_un, sun_path) + 1 + endpoint.path.size();
+        }
+        else
+        {
+            std::memcpy(&osAddressLocal->sun_path[0], endpoint.path.data(), endpoint.path.size());
+
+            osAddressLength = sizeof(sockaddr_un);
+        }
+
+        osProtocol = 0;
+    }
+
+    Server::Socket osListenerSocket = ::socket(osAddress.ss_family, SOCK_STREAM, osProtocol);
+
+    if (-1 == osListenerSocket)
     {
-        ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, osPeerSocket, NULL);
-        ::close(osPeerSocket);
+        throw Server::Errors::OpenSocket();
     }
 
-    ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, this->osListenerSocket, NULL);
+    bool bound = false;
 
-    ::close(this->osEpollDescriptor);
-    ::close(this->osListenerSocket);
+    try
+    {
+        if (Server::Endpoint::Family::IPv6 == endpoint.family)
+        {
+            int osIPv6Only = 0;
+
+            if (-1 == ::setsockopt(
+                osListenerSocket, IPPROTO_IPV6, IPV6_V6ONLY, &osIPv6Only, sizeof(osIPv6Only)
+            ))
+            {
+                throw Server::Errors::TweakSocket();
+            }
+        }
+
+        if ((Server::Endpoint::Family::Local != endpoint.family) && (endpoint.shared))
+        {
+            int osReusePort = 1;
+
+            if (-1 == ::setsockopt(
+                osListenerSocket, SOL_SOCKET, SO_REUSEPORT, &osReusePort, sizeof(osReusePort)
+            ))
+            {
+                throw Server::Errors::TweakSocket();
+            }
+        }
+
+        if ((Server::Endpoint::Family::Local == endpoint.family) && (!endpoint.abstract))
+        {
+            // Remove the socket left behind by a previous run, otherwise
+            // binding fails with `EADDRINUSE`. Anything else at the path (a
+            // regular file, or a live server's socket) is left alone, and
+            // binding fails instead.
+            if (stale(endpoint.path, (sockaddr*) &osAddress, osAddressLength))
+            {
+                ::unlink(endpoint.path.c_str());
+            }
+        }
+
+        if (-1 == ::bind(osListenerSocket, (sockaddr*) &osAddress, osAddressLength))
+        {
+            throw Server::Errors::BindSocket();
+        }
+
+        bound = true;
+
+        if (-1 == ::listen(osListenerSocket, 128))
+        {
+            throw Server::Errors::ListenSocket();
+        }
+
+        // TODO: Retrieve old flags?
+        if (-1 == ::fcntl(osListenerSocket, F_SETFL, O_NONBLOCK))
+        {
+            throw Server::Errors::UnblockSocket();
+        }
+    }
+    catch (...)
+    {
+        // NOTE: The socket file only exists once binding succeeded, and must
+        // not be removed otherwise, since it may belong to someone else.
+        if (bound)
+        {
+            Server::release(Server::Listener { osListenerSocket, endpoint });
+        }
+        else
+        {
+            ::close(osListenerSocket);
+        }
+
+        throw;
+    }
+
+    return osListenerSocket;
 }
 
-Server Server::listen(std::uint16_t port, Server::Handlers handlers)
+void Server::release(const Server::Listener& osListener)
 {
-    Server::Socket osListenerSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    
-    if (-1 == osListenerSocket)
+    ::close(osListener.osSocket);
+
+    if (
+        (Server::Endpoint::Family::Local == osListener.endpoint.family) &&
+        (!osListener.endpoint.abstract)
+    )
     {
-        throw Server::Errors::OpenSocket();
+        ::unlink(osListener.endpoint.path.c_str());
     }
+}
+
+bool Server::accept(std::size_t listenerIndex)
+{
+    sockaddr_storage osAddress = {};
+    socklen_t osAddressLength = sizeof(osAddress);
+    Server::Socket osPeerSocket = ::accept(
+        this->osListeners[listenerIndex].osSocket,
+        (sockaddr*) &osAddress,
+        &osAddressLength
+    );
+
+    if (-1 == osPeerSocket)
+    {
+        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            // NOTE: The backlog has been drained, since `poll` keeps
+            // accepting until it runs out of connections or budget.
+            return false;
+        }
+        else
+        {
+            throw Server::Errors::AcceptSocket();
+        }
+    }
+    else
+    {
+        std::uint64_t source = hashSource(osAddress);
+
+        if (!this->admissible(source))
+        {
+            // Reset instead of closing gracefully, so that rejections do not
+            // leave sockets lingering in `TIME_WAIT`.
+            linger osLinger = {};
+
+            osLinger.l_onoff = 1;
+            osLinger.l_linger = 0;
+
+            ::setsockopt(osPeerSocket, SOL_SOCKET, SO_LINGER, &osLinger, sizeof(osLinger));
+            ::close(osPeerSocket);
+
+            return true;
+        }
+
+        this->admit(osPeerSocket, listenerIndex, source);
 
-    sockaddr_in osAddress = {};
+        return true;
+    }
+}
 
-    osAddress.sin_family = AF_INET;
-    osAddress.sin_addr.s_addr = INADDR_ANY;
-    osAddress.sin_port = ::htons(port);
+bool Server::admissible(std::uint64_t source)
+{
+    if ((0 != this->limits.connections) && (this->osPeers.size() >= this->limits.connections))
+    {
+        return false;
+    }
 
-    if (-1 == ::bind(osListenerSocket, (sockaddr*) &osAddress, sizeof(osAddress)))
+    if (
+        (0 != this->limits.connectionsPerSource) &&
+        (0 != source) &&
+        (this->sourceConnections[source % this->sourceConnections.size()] >= this->limits.connectionsPerSource)
+    )
     {
-        throw Server::Errors::BindSocket();
+        return false;
     }
 
-    if (-1 == ::listen(osListenerSocket, 128))
+    // NOTE: Checked last, so connections rejected by the caps above do not
+    // spend tokens.
+    if (0 < this->limits.acceptsPerSecond)
     {
-        throw Server::Errors::ListenSocket();
+        Server::Clock::time_point now = Server::Clock::now();
+
+        this->acceptsBucket.tokens = refill(
+            this->acceptsBucket.tokens,
+            this->limits.acceptsPerSecond,
+            this->limits.acceptsBurst,
+            now - this->acceptsBucket.refilledAt
+        );
+        this->acceptsBucket.refilledAt = now;
+
+        if (1.0 > this->acceptsBucket.tokens)
+        {
+            return false;
+        }
+
+        this->acceptsBucket.tokens -= 1.0;
     }
 
+    return true;
+}
+
+void Server::admit(Server::Socket osPeerSocket, std::size_t listenerIndex, std::uint64_t source)
+{
     // TODO: Retrieve old flags?
-    if (-1 == ::fcntl(osListenerSocket, F_SETFL, O_NONBLOCK))
+    if (-1 == ::fcntl(osPeerSocket, F_SETFL, O_NONBLOCK))
     {
         throw Server::Errors::UnblockSocket();
     }
 
-    int osEpollDescriptor = ::epoll_create1(0);
+    Server::Peer peer = {};
 
-    if (-1 == osEpollDescriptor)
+    peer.listenerIndex = listenerIndex;
+    peer.source = source;
+    peer.bytesTokens = this->limits.bytesBurst;
+    peer.messagesTokens = this->limits.messagesBurst;
+    peer.refilledAt = Server::Clock::now();
+
+    this->enroll(osPeerSocket, std::move(peer));
+    this->handlers.handlePeerConnection(this, osPeerSocket);
+}
+
+void Server::enroll(Server::Socket osPeerSocket, Server::Peer peer)
+{
+    epoll_event osEpollEvent = {};
+
+    osEpollEvent.data.fd = osPeerSocket;
+    osEpollEvent.events = EPOLLERR;
+
+    if (!peer.paused)
     {
-        throw Server::Errors::OpenEpoll();
+        osEpollEvent.events |= EPOLLIN;
+    }
+
+    if (!peer.output.empty())
+    {
+        osEpollEvent.events |= EPOLLOUT;
+    }
+
+    if (-1 == ::epoll_ctl(
+        this->osEpollDescriptor, EPOLL_CTL_ADD, osPeerSocket, &osEpollEvent
+    ))
+    {
+        throw Server::Errors::AttachEpoll();
+    }
+
+    if (0 != peer.source)
+    {
+        this->sourceConnections[peer.source % this->sourceConnections.size()]++;
+    }
+
+    // NOTE: A peer attached while throttled stays paused until the time it
+    // was given by the server it came from.
+    if (peer.paused)
+    {
+        this->osPausedPeers.emplace(peer.resumeAt, osPeerSocket);
+    }
+
+    this->osPeers[osPeerSocket] = std::move(peer);
+}
+
+void Server::dismiss(const Server::Peer& peer)
+{
+    if (0 != peer.source)
+    {
+        this->sourceConnections[peer.source % this->sourceConnections.size()]--;
     }
+}
 
+void Server::watch(Server::Socket osPeerSocket)
+{
+    const Server::Peer& peer = this->osPeers.at(osPeerSocket);
     epoll_event osEpollEvent = {};
 
-    osEpollEvent.data.fd = osListenerSocket;
-    osEpollEvent.events = EPOLLIN | EPOLLERR;
+    osEpollEvent.data.fd = osPeerSocket;
+    osEpollEvent.events = EPOLLERR;
+
+    if (!peer.paused)
+    {
+        osEpollEvent.events |= EPOLLIN;
+    }
+
+    if (!peer.output.empty())
+    {
+        osEpollEvent.events |= EPOLLOUT;
+    }
 
     if (-1 == ::epoll_ctl(
-        osEpollDescriptor, EPOLL_CTL_ADD, osListenerSocket, &osEpollEvent
+        this->osEpollDescriptor, EPOLL_CTL_MOD, osPeerSocket, &osEpollEvent
     ))
     {
         throw Server::Errors::AttachEpoll();
     }
-
-    return Server(osListenerSocket, osEpollDescriptor, handlers);
 }
 
-void Server::poll()
+void Server::collect()
 {
-    std::array<epoll_event, 128> osEpollEvents;
-    int osEpollEventsCount = ::epoll_wait(this->osEpollDescriptor, &osEpollEvents[0], 128, 0);
+    std::vector<std::pair<Server::Socket, Server::Context>> attachments = {};
+    std::vector<Server::Migration> migrations = {};
 
-    if (-1 == osEpollEventsCount)
     {
-        throw Server::Errors::WaitEpoll();
+        std::lock_guard<std::mutex> lock(this->mailbox->mutex);
+
+        std::swap(attachments, this->mailbox->attachments);
+        std::swap(migrations, this->mailbox->migrations);
+
+        this->mailbox->pending.store(false, std::memory_order_relaxed);
     }
 
-    for (int i = 0; i < osEpollEventsCount; i++)
+    for (auto& [osPeerSocket, context] : attachments)
     {
-        if (osEpollEvents[i].data.fd == this->osListenerSocket)
+        std::size_t listenerIndex = SIZE_MAX;
+
+        // NOTE: Servers sharing a port through shared endpoints listen on the
+        // same endpoints, so the origin still maps to a listener there.
+        for (std::size_t i = 0; (context.origin) && (i < this->osListeners.size()); i++)
         {
-            if (osEpollEvents[i].events & EPOLLERR)
+            if (equals(this->osListeners[i].endpoint, *context.origin))
             {
-                throw Server::Errors::BrokenListener();
+                listenerIndex = i;
+                break;
+            }
+        }
+
+        Server::Peer peer = {};
+
+        peer.listenerIndex = listenerIndex;
+        peer.source = context.source;
+        peer.output = std::move(context.output);
+        peer.statistics = context.statistics;
+        peer.bytesTokens = context.bytesTokens;
+        peer.messagesTokens = context.messagesTokens;
+        peer.refilledAt = context.refilledAt;
+        peer.paused = context.paused;
+        peer.resumeAt = context.resumeAt;
+
+        this->enroll(osPeerSocket, std::move(peer));
+
+        if (this->handlers.handlePeerAttachment)
+        {
+            this->handlers.handlePeerAttachment(this, osPeerSocket, std::move(context.payload));
+        }
+    }
+
+    for (const auto& [count, target, share] : migrations)
+    {
+        if ((this == target) || (0 == count))
+        {
+            continue;
+        }
+
+        // The busiest peers are the ones that made this server read the most
+        // since the previous migration, then the ones that sent more bytes.
+        // Idle peers would not relieve this server, so they stay.
+        std::vector<std::pair<Server::Statistics, Server::Socket>> candidates = {};
+        std::uint64_t totalEvents = 0;
+
+        for (const auto& [osPeerSocket, peer] : this->osPeers)
+        {
+            totalEvents += peer.recentStatistics.events;
+
+            if (0 != peer.recentStatistics.events)
+            {
+                candidates.emplace_back(peer.recentStatistics, osPeerSocket);
             }
+        }
 
-            if (osEpollEvents[i].events & EPOLLIN)
+        std::sort(
+            std::begin(candidates),
+            std::end(candidates),
+            [](const auto& left, const auto& right)
             {
-                this->accept();
+                return (left.first.events != right.first.events)
+                    ? (left.first.events > right.first.events)
+                    : (left.first.bytes > right.first.bytes);
             }
-        } 
-        else
+        );
+
+        // NOTE: The budget is a share of this server's own recent events,
+        // since those span the same period as the peers' ones. A peer too
+        // heavy for it is skipped (e.g. a single hot peer, which would just
+        // make its load bounce between servers), but lighter ones may fit.
+        double budget = share * (double) totalEvents;
+        std::size_t migrationsCount = 0;
+
+        for (const auto& [recentStatistics, osPeerSocket] : candidates)
         {
-            if (osEpollEvents[i].events & EPOLLERR)
+            if (migrationsCount >= count)
             {
-                throw Server::Errors::BrokenPeer();
+                break;
             }
-            else
+
+            if ((double) recentStatistics.events > budget)
             {
-                this->read(osEpollEvents[i].data.fd);
+                continue;
             }
+
+            budget -= (double) recentStatistics.events;
+            migrationsCount++;
+
+            target->attach(osPeerSocket, this->detach(osPeerSocket));
+        }
+
+        for (auto& [osPeerSocket, peer] : this->osPeers)
+        {
+            peer.recentStatistics = {};
         }
     }
 }
 
-void Server::send(Server::Socket osPeerSocket, char* buffer, std::size_t bufferLength)
+bool Server::throttle(Server::Socket osPeerSocket, Server::Peer& peer)
 {
-    if (-1 == ::send(osPeerSocket, (void*) buffer, bufferLength, 0))
+    if ((0 >= this->limits.bytesPerSecond) && (0 >= this->limits.messagesPerSecond))
     {
-        throw Server::Errors::WriteSocket();
+        return false;
     }
-}
 
-void Server::kick(Server::Socket osPeerSocket)
-{
-    // NOTE: This can be optimized with a map of descriptors-to-indexes,
-    // reducing this search's time complexity to O(log(n)). Since it is
-    // not a priority, I choose the simplest solution.
-    auto iterator = std::find(
-        std::begin(this->osPeersSockets), 
-        std::end(this->osPeersSockets), 
-        osPeerSocket
-    );
+    Server::Clock::time_point now = Server::Clock::now();
+    double waitSeconds = 0;
 
-    if (std::end(this->osPeersSockets) != iterator)
+    if (0 < this->limits.bytesPerSecond)
     {
-        // Swap-and-remove, to avoid moving down all elements above the
-        // iterator.
-        std::iter_swap(iterator, std::end(this->osPeersSockets) - 1);
-        this->osPeersSockets.pop_back();
-    }
+        peer.bytesTokens = refill(
+            peer.bytesTokens,
+            this->limits.bytesPerSecond,
+            this->limits.bytesBurst,
+            now - peer.refilledAt
+        );
 
-    if (-1 == ::epoll_ctl(this->osEpollDescriptor, EPOLL_CTL_DEL, osPeerSocket, NULL))
-    {
-        throw Server::Errors::DetachEpoll();
+        // NOTE: A read may take more bytes than there are tokens, leaving the
+        // bucket in debt, since the size is only known after reading.
+        if (1.0 > peer.bytesTokens)
+        {
+            waitSeconds = std::max(waitSeconds, (1.0 - peer.bytesTokens) / this->limits.bytesPerSecond);
+        }
     }
 
-    if (-1 == ::close(osPeerSocket))
+    if (0 < this->limits.messagesPerSecond)
     {
-        throw Server::Errors::CloseSocket();
+        peer.messagesTokens = refill(
+            peer.messagesTokens,
+            this->limits.messagesPerSecond,
+            this->limits.messagesBurst,
+            now - peer.refilledAt
+        );
+
+        if (1.0 > peer.messagesTokens)
+        {
+            waitSeconds = std::max(waitSeconds, (1.0 - peer.messagesTokens) / this->limits.messagesPerSecond);
+        }
     }
-    else
+
+    peer.refilledAt = now;
+
+    if (0 == waitSeconds)
     {
-        this->handlers.handlePeerDisconnection(this, osPeerSocket);
+        return false;
     }
-}
 
-Server::Server(
-    Server::Socket osListenerSocket,
-    int osEpollDescriptor,
-    Server::Handlers handlers
-)
-{
-    this->osListenerSocket = osListenerSocket;
-    this->osEpollDescriptor = osEpollDescriptor;
-    this->osPeersSockets = {};
-    this->handlers = handlers;
+    peer.paused = true;
+    peer.resumeAt = now + std::chrono::duration_cast<Server::Clock::duration>(
+        std::chrono::duration<double>(waitSeconds)
+    );
+
+    this->watch(osPeerSocket);
+    this->osPausedPeers.emplace(peer.resumeAt, osPeerSocket);
+
+    return true;
 }
 
-void Server::accept()
+void Server::resume()
 {
-    sockaddr osAddress = {};
-    socklen_t osAddressLength = {};
-    Server::Socket osPeerSocket = ::accept(this->osListenerSocket, &osAddress, &osAddressLength);
+    Server::Clock::time_point now = Server::Clock::now();
 
-    if (-1 == osPeerSocket)
+    while ((!this->osPausedPeers.empty()) && (this->osPausedPeers.top().first <= now))
     {
-        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
-        {
-            // NOTE: This should not ever happen because this method is called
-            // after the listener socket is signaled by the edge polling
-            // `wait` call.
-            throw Server::Errors::AcceptSocket();
-        }
-        else
+        auto [resumeAt, osPeerSocket] = this->osPausedPeers.top();
+
+        this->osPausedPeers.pop();
+
+        // NOTE: Entries of peers that were kicked or detached meanwhile are
+        // left in the queue, and skipped here. Descriptors get reused, so an
+        // entry only counts if it is the one its peer is waiting for.
+        auto iterator = this->osPeers.find(osPeerSocket);
+
+        if (
+            (std::end(this->osPeers) != iterator) &&
+            (iterator->second.paused) &&
+            (resumeAt == iterator->second.resumeAt)
+        )
         {
-            throw Server::Errors::AcceptSocket();
+            iterator->second.paused = false;
+
+            this->watch(osPeerSocket);
         }
     }
-    else
+}
+
+void Server::flush(Server::Socket osPeerSocket)
+{
+    Server::Peer& peer = this->osPeers.at(osPeerSocket);
+    ssize_t sentLength = ::send(
+        osPeerSocket, (void*) peer.output.data(), peer.output.size(), MSG_NOSIGNAL
+    );
+
+    if (-1 == sentLength)
     {
-        // TODO: Retrieve old flags?
-        if (-1 == ::fcntl(osPeerSocket, F_SETFL, O_NONBLOCK))
+        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
         {
-            throw Server::Errors::UnblockSocket();
+            return;
         }
 
-        epoll_event osEpollEvent = {};
-
-        osEpollEvent.data.fd = osPeerSocket;
-        osEpollEvent.events = EPOLLIN | EPOLLERR;
+        throw Server::Errors::WriteSocket();
+    }
 
-        if (-1 == ::epoll_ctl(
-            this->osEpollDescriptor, EPOLL_CTL_ADD, osPeerSocket, &osEpollEvent
-        ))
-        {
-            throw Server::Errors::AttachEpoll();
-        }
+    peer.output.erase(0, sentLength);
 
-        this->osPeersSockets.push_back(osPeerSocket);
-        this->handlers.handlePeerConnection(this, osPeerSocket);
+    if (peer.output.empty())
+    {
+        this->watch(osPeerSocket);
     }
 }
 
-void Server::read(Server::Socket osPeerSocket)
+std::size_t Server::read(Server::Socket osPeerSocket)
 {
+    Server::Peer& peer = this->osPeers.at(osPeerSocket);
+
+    if (peer.paused || this->throttle(osPeerSocket, peer))
+    {
+        return 0;
+    }
+
     char buffer[1028];
     ssize_t bufferLength = ::read(osPeerSocket, &buffer[0], 1028);
 
     if (-1 == bufferLength)
     {
+        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            return 0;
+        }
+
         throw Server::Errors::ReadSocket();
     }
     else if (0 == bufferLength)
     {
         this->kick(osPeerSocket);
+
+        return 0;
     }
     else
     {
+        peer.statistics.bytes += bufferLength;
+        peer.statistics.events++;
+        peer.recentStatistics.bytes += bufferLength;
+        peer.recentStatistics.events++;
+
+        if (0 < this->limits.bytesPerSecond)
+        {
+            peer.bytesTokens -= bufferLength;
+        }
+
+        if (0 < this->limits.messagesPerSecond)
+        {
+            peer.messagesTokens -= 1.0;
+        }
+
         // NOTE: Casting from signed-to-unsigned is well-defined. Since `bufferLength` is greater
         // than 0 from here on, casting it should not change the actual value (e.g. 10i8 == 10u8).
         this->handlers.handleDataArrival(
@@ -234,5 +1292,7 @@ void Server::read(Server::Socket osPeerSocket)
             &buffer[0],
             (std::size_t) bufferLength
         );
+
+        return (std::size_t) bufferLength;
     }
 }
@@ -1,8 +1,18 @@
 #ifndef SELX_EPOLL_HPP
 #define SELX_EPOLL_HPP
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace selx::epoll {
@@ -17,6 +27,136 @@ namespace selx::epoll {
                 std::function<void(Server*, Socket)>                       	handlePeerConnection;
                 std::function<void(Server*, Socket)>                       	handlePeerDisconnection;
                 std::function<void(Server*, Socket, char*, std::size_t)>	handleDataArrival;
+                // Optional. Called by `detach`, returning whatever per-peer
+                // state the handlers keep (e.g. a half-parsed request), which
+                // `handlePeerAttachment` gets back on the destination server.
+                std::function<std::shared_ptr<void>(Server*, Socket)>        	handlePeerDetachment;
+                std::function<void(Server*, Socket, std::shared_ptr<void>)> 	handlePeerAttachment;
+            };
+
+            struct Endpoint {
+
+                enum class Family {
+                    IPv4,
+                    IPv6,
+                    Local,
+                };
+
+                Family          family;
+                std::uint16_t   port;
+                std::string     path;
+                bool            abstract;
+                // Whether other servers (e.g. one per thread) may listen on
+                // the same port, through `SO_REUSEPORT`. The kernel spreads
+                // new connections among them, and peers migrated between them
+                // keep their origin. Only applies to IPv4 and IPv6.
+                bool            shared;
+
+                // Listens on every IPv4 interface.
+                Endpoint static ipv4(std::uint16_t port, bool shared = false);
+                // Listens on every IPv6 interface. The socket is dual-stack, so
+                // IPv4 clients are accepted too (as IPv4-mapped addresses).
+                Endpoint static ipv6(std::uint16_t port, bool shared = false);
+                // Listens on a Unix stream socket bound to a filesystem path.
+                Endpoint static local(std::string path);
+                // Listens on a Unix stream socket in the abstract namespace,
+                // which has no filesystem presence.
+                Endpoint static abstractLocal(std::string name);
+
+            };
+
+            struct Policy {
+
+                enum class Priority {
+                    // Pending connections are accepted before reading peers.
+                    Accepts,
+                    // Peers are read before accepting pending connections.
+                    Peers,
+                };
+
+                // Bounds for the number of events fetched by each `poll`. The
+                // batch doubles when it comes back full and halves when it
+                // comes back mostly empty.
+                std::size_t                 minimumEvents = 32;
+                std::size_t                 maximumEvents = 4096;
+
+                // Per-`poll` budgets. Once one runs out, the remaining events
+                // are left for the next `poll`, which serves the skipped peers
+                // first. Listeners are simply reported again, and only stop
+                // accepting on the accepts and time budgets.
+                std::size_t                 acceptsBudget = SIZE_MAX;
+                std::size_t                 bytesBudget = SIZE_MAX;
+                // Time spent dispatching events, which is mostly spent in
+                // handlers. Zero means unlimited.
+                std::chrono::microseconds   timeBudget = std::chrono::microseconds::zero();
+
+                // Reads issued for a single readable peer in one `poll`.
+                std::size_t                 readsPerPeer = 1;
+
+                // Bytes `send` may queue for a peer whose socket is full. A
+                // peer that would exceed it (e.g. because it never reads) is
+                // kicked. Zero means unlimited.
+                std::size_t                 maximumOutput = 4 * 1024 * 1024;
+
+                Priority                    priority = Priority::Accepts;
+
+            };
+
+            struct Limits {
+
+                // Connections over these caps are closed as soon as they are
+                // accepted, without calling any handler. Zero means unlimited.
+                std::size_t     connections = 0;
+                std::size_t     connectionsPerSource = 0;
+                // Slots of the fixed-size table counting connections per
+                // source address. Addresses sharing a slot share their cap,
+                // so collisions only make it stricter.
+                std::size_t     sourceSlots = 4096;
+
+                // Token buckets. A zero rate means unlimited. A zero burst
+                // allows one second worth of the rate, and any burst is
+                // raised to at least one token, so slow rates (e.g. 0.5 per
+                // second) still let something through.
+                double          acceptsPerSecond = 0;
+                double          acceptsBurst = 0;
+                // Per-peer buckets, where each read counts as a message. An
+                // exhausted peer is not read until its bucket refills, so its
+                // data waits in the socket and TCP slows the sender down.
+                double          bytesPerSecond = 0;
+                double          bytesBurst = 0;
+                double          messagesPerSecond = 0;
+                double          messagesBurst = 0;
+
+            };
+
+            using Clock = std::chrono::steady_clock;
+
+            struct Statistics {
+                std::uint64_t   bytes;
+                std::uint64_t   events;
+            };
+
+            // Everything a peer takes along when it moves between servers.
+            // Input the server has not read yet stays in the socket's receive
+            // buffer, so it moves with the descriptor itself. Input already
+            // handed to the handlers is carried by `payload`.
+            struct Context {
+                std::optional<Endpoint>     origin;
+                // Hashed source address, counted by per-source caps. Zero if
+                // the peer has none (e.g. Unix sockets).
+                std::uint64_t               source;
+                // Bytes queued by `send` which the socket did not accept yet.
+                std::string                 output;
+                Statistics                  statistics;
+                // Per-peer token buckets, so that moving does not refill them.
+                double                      bytesTokens;
+                double                      messagesTokens;
+                Clock::time_point           refilledAt;
+                // Whether the peer is throttled, and until when.
+                bool                        paused;
+                Clock::time_point           resumeAt;
+                // Returned by `handlePeerDetachment`.
+                std::shared_ptr<void>       payload;
             };
 
             class Errors {
@@ -27,6 +167,7 @@ namespace selx::epoll {
                     class BindSocket : std::exception {};
                     class ListenSocket : std::exception {};
                     class UnblockSocket : std::exception {};
+                    class TweakSocket : std::exception {};
                     class AcceptSocket : std::exception {};
                     class ReadSocket : std::exception {};
                     class WriteSocket : std::exception {};
@@ -40,6 +181,8 @@ namespace selx::epoll {
                     class BrokenListener : std::exception {};
                     class BrokenPeer : std::exception {};
 
+                    class UnknownPeer : std::exception {};
+
                     Errors() = delete;
                     ~Errors() = delete;
 
@@ -55,25 +198,124 @@ namespace selx::epoll {
             ~Server();
 
             Server static listen(std::uint16_t port, Handlers handlers);
+            Server static listen(std::vector<Endpoint> endpoints, Handlers handlers);
             void poll();
             void send(Socket osPeerSocket, char* buffer, std::size_t bufferLength);
             void kick(Socket osPeerSocket);
 
+            // Registers an already connected socket (e.g. one end of a
+            // `socketpair`) as a peer, as if it had been accepted.
+            void adopt(Socket osPeerSocket);
+
+            // Replaces the batching and fairness policy used by `poll`.
+            void configure(Policy policy);
+            // Replaces the admission and rate limits.
+            void limit(Limits limits);
+
+            // Returns the endpoint whose listener accepted the given peer. It
+            // can already be queried from within `handlePeerConnection`.
+            // Adopted peers have no endpoint, so they are reported as unknown.
+            const Endpoint& origin(Socket osPeerSocket) const;
+
+            // Removes a live peer from this server without closing it or
+            // calling `handlePeerDisconnection`.
+            Context detach(Socket osPeerSocket);
+            // Hands a detached peer over to this server, which picks it up on
+            // its next `poll` without calling `handlePeerConnection`. Safe to
+            // call from any thread.
+            void attach(Socket osPeerSocket, Context context);
+            // Asks this server to move up to `count` of its busiest peers
+            // (since the previous request) to `target` on its next `poll`.
+            // Peers are only taken while their events add up to at most
+            // `share` of the events of all its peers, and idle peers are never
+            // taken. Safe to call from any thread.
+            void migrate(std::size_t count, Server* target, double share = 1.0);
+
+            // Activity of a peer since it was accepted, adopted or attached.
+            const Statistics& statistics(Socket osPeerSocket) const;
+            // Activity of every peer this server ever had. Safe to call from
+            // any thread.
+            Statistics load() const;
+
         private:
 
-            Socket             	osListenerSocket;
-            int                 osEpollDescriptor;
-            std::vector<Socket>	osPeersSockets;
-            Handlers            handlers;
+            struct Listener {
+                Socket          osSocket;
+                Endpoint        endpoint;
+            };
+
+            struct Peer {
+                std::size_t         listenerIndex = SIZE_MAX;
+                std::uint64_t       source = 0;
+                std::string         output = {};
+                Statistics          statistics = {};
+                Statistics          recentStatistics = {};
+                bool                paused = false;
+                Clock::time_point   resumeAt = {};
+                double              bytesTokens = 0;
+                double              messagesTokens = 0;
+                Clock::time_point   refilledAt = {};
+            };
+
+            struct Bucket {
+                double              tokens;
+                Clock::time_point   refilledAt;
+            };
+
+            using Pause = std::pair<Clock::time_point, Socket>;
+
+            struct Migration {
+                std::size_t         count;
+                Server*             target;
+                double              share;
+            };
+
+            // State shared with other threads. It lives on the heap so that
+            // servers can still be moved.
+            struct Mailbox {
+                std::mutex                                          mutex;
+                std::atomic<bool>                                   pending;
+                std::vector<std::pair<Socket, Context>>             attachments;
+                std::vector<Migration>                              migrations;
+                std::atomic<std::uint64_t>                          bytes;
+                std::atomic<std::uint64_t>                          events;
+            };
+
+            std::vector<Listener>               	osListeners;
+            int                                 	osEpollDescriptor;
+            std::vector<epoll_event>            	osEpollEvents;
+            std::unordered_map<Socket, Peer>    	osPeers;
+            std::unordered_set<Socket>          	osDeferredPeers;
+            Handlers                            	handlers;
+            Policy                              	policy;
+            Limits                              	limits;
+            std::vector<std::uint32_t>          	sourceConnections;
+            Bucket                              	acceptsBucket;
+            std::priority_queue<
+                Pause, std::vector<Pause>, std::greater<Pause>
+            >                                   	osPausedPeers;
+            std::unique_ptr<Mailbox>            	mailbox;
 
             Server(
-                Socket osListenerSocket,
+                std::vector<Listener> osListeners,
                 int osEpollDescriptor,
                 Handlers handlers
             );
 
-            void accept();
-            void read(Socket osPeerSocket);
+            Socket static open(const Endpoint& endpoint);
+            void static release(const Listener& osListener);
+
+            bool accept(std::size_t listenerIndex);
+            bool admissible(std::uint64_t source);
+            void admit(Socket osPeerSocket, std::size_t listenerIndex, std::uint64_t source);
+            void enroll(Socket osPeerSocket, Peer peer);
+            void dismiss(const Peer& peer);
+            void watch(Socket osPeerSocket);
+            bool throttle(Socket osPeerSocket, Peer& peer);
+            void resume();
+            void collect();
+            void flush(Socket osPeerSocket);
+            std::size_t read(Socket osPeerSocket);
 
     };
 
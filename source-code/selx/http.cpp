@@ -0,0 +1,673 @@
+#include <memory>
+#include <unordered_map>
+#include "http.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define SELX_HTTP_X86
+    #include <immintrin.h>
+#endif
+
+using namespace selx::http;
+
+namespace {
+
+    using FindByte = const char* (*)(const char* begin, const char* end, char byte);
+
+    const char* findByteScalar(const char* begin, const char* end, char byte)
+    {
+        for (; begin < end; begin++)
+        {
+            if (byte == *begin)
+            {
+                return begin;
+            }
+        }
+
+        return end;
+    }
+
+#if defined(SELX_HTTP_X86)
+    __attribute__((target("sse2")))
+    const char* findByteSSE2(const char* begin, const char* end, char byte)
+    {
+        const __m128i needle = _mm_set1_epi8(byte);
+
+        while (end - begin >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i*) begin);
+            unsigned int mask = (unsigned int) _mm_movemask_epi8(
+                _mm_cmpeq_epi8(chunk, needle)
+            );
+
+            if (0 != mask)
+            {
+                return begin + __builtin_ctz(mask);
+            }
+
+            begin += 16;
+        }
+
+        return findByteScalar(begin, end, byte);
+    }
+
+    __attribute__((target("avx2")))
+    const char* findByteAVX2(const char* begin, const char* end, char byte)
+    {
+        const __m256i needle = _mm256_set1_epi8(byte);
+
+        while (end - begin >= 32)
+        {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*) begin);
+            unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(chunk, needle)
+            );
+
+            if (0 != mask)
+            {
+                return begin + __builtin_ctz(mask);
+            }
+
+            begin += 32;
+        }
+
+        return findByteScalar(begin, end, byte);
+    }
+#endif
+
+    // Returns `nullptr` if this build or CPU lacks the scanner.
+    FindByte findByteFor(Scanner scanner)
+    {
+        if (Scanner::Scalar == scanner)
+        {
+            return findByteScalar;
+        }
+
+#if defined(SELX_HTTP_X86)
+        __builtin_cpu_init();
+
+        if ((Scanner::SSE2 == scanner) && (__builtin_cpu_supports("sse2")))
+        {
+            return findByteSSE2;
+        }
+
+        if ((Scanner::AVX2 == scanner) && (__builtin_cpu_supports("avx2")))
+        {
+            return findByteAVX2;
+        }
+#endif
+
+        return nullptr;
+    }
+
+    FindByte selectFindByte()
+    {
+        for (Scanner scanner : { Scanner::AVX2, Scanner::SSE2 })
+        {
+            if (FindByte candidate = findByteFor(scanner))
+            {
+                return candidate;
+            }
+        }
+
+        return findByteScalar;
+    }
+
+    // NOTE: Resolved once at startup, so the CPU is not queried on every
+    // call. Only `useScanner` changes it afterwards.
+    FindByte findByte = selectFindByte();
+
+    // Same as `std::string_view::find`, but through `findByte`.
+    std::size_t findIn(std::string_view text, char byte, std::size_t position = 0)
+    {
+        if (position >= text.size())
+        {
+            return std::string_view::npos;
+        }
+
+        const char* end = text.data() + text.size();
+        const char* found = findByte(text.data() + position, end, byte);
+
+        return (end == found) ? std::string_view::npos : (std::size_t) (found - text.data());
+    }
+
+    // Returns the end of the first empty line (i.e. the end of the head), or
+    // `nullptr` if the head has not fully arrived yet.
+    const char* findHeadEnd(const char* begin, const char* end)
+    {
+        for (
+            const char* line = findByte(begin, end, '\n');
+            end != line;
+            line = findByte(line + 1, end, '\n')
+        )
+        {
+            if ((end - line >= 2) && ('\n' == line[1]))
+            {
+                return line + 2;
+            }
+
+            if ((end - line >= 3) && ('\r' == line[1]) && ('\n' == line[2]))
+            {
+                return line + 3;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::string_view trimLine(const char* begin, const char* end)
+    {
+        if ((begin != end) && ('\r' == *(end - 1)))
+        {
+            end--;
+        }
+
+        return std::string_view(begin, end - begin);
+    }
+
+    std::string_view trimSpaces(std::string_view text)
+    {
+        while ((!text.empty()) && ((' ' == text.front()) || ('\t' == text.front())))
+        {
+            text.remove_prefix(1);
+        }
+
+        while ((!text.empty()) && ((' ' == text.back()) || ('\t' == text.back())))
+        {
+            text.remove_suffix(1);
+        }
+
+        return text;
+    }
+
+    bool equalsIgnoringCase(std::string_view left, std::string_view right)
+    {
+        if (left.size() != right.size())
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < left.size(); i++)
+        {
+            // NOTE: Header names are ASCII, so folding with a bit is enough.
+            if ((left[i] | 0x20) != (right[i] | 0x20))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool containsToken(std::string_view list, std::string_view token)
+    {
+        while (!list.empty())
+        {
+            std::size_t comma = list.find(',');
+
+            if (equalsIgnoringCase(trimSpaces(list.substr(0, comma)), token))
+            {
+                return true;
+            }
+
+            list.remove_prefix((std::string_view::npos == comma) ? list.size() : comma + 1);
+        }
+
+        return false;
+    }
+
+}
+
+bool selx::http::useScanner(Scanner scanner)
+{
+    FindByte candidate = findByteFor(scanner);
+
+    if (nullptr == candidate)
+    {
+        return false;
+    }
+
+    findByte = candidate;
+
+    return true;
+}
+
+std::string_view Request::header(std::string_view name) const
+{
+    for (const Header& header : this->headers)
+    {
+        if (equalsIgnoringCase(header.name, name))
+        {
+            return header.value;
+        }
+    }
+
+    return {};
+}
+
+Parser::Parser(std::size_t maximumLength)
+{
+    this->maximumLength = maximumLength;
+    this->pending = {};
+    this->scannedLength = 0;
+    this->headLength = 0;
+    this->bodyLength = 0;
+    this->request = {};
+}
+
+void Parser::feed(
+    char* buffer,
+    std::size_t bufferLength,
+    const std::function<void(const Request&)>& handleRequest
+)
+{
+    if (this->pending.empty())
+    {
+        // Fast path: parse straight from the receive buffer, and only copy
+        // the tail of a request split across reads.
+        std::size_t consumedLength = this->consume(buffer, bufferLength, handleRequest);
+
+        this->pending.assign(buffer + consumedLength, buffer + bufferLength);
+    }
+    else
+    {
+        this->pending.insert(std::end(this->pending), buffer, buffer + bufferLength);
+
+        std::size_t consumedLength = this->consume(
+            this->pending.data(), this->pending.size(), handleRequest
+        );
+
+        this->pending.erase(
+            std::begin(this->pending),
+            std::begin(this->pending) + consumedLength
+        );
+    }
+}
+
+std::size_t Parser::consume(
+    char* buffer,
+    std::size_t bufferLength,
+    const std::function<void(const Request&)>& handleRequest
+)
+{
+    std::size_t offset = 0;
+
+    while (offset < bufferLength)
+    {
+        // Empty lines preceding a request line are ignored (RFC 9112,
+        // section 2.2).
+        if ((0 == this->headLength) && (0 == this->scannedLength))
+        {
+            if (('\r' == buffer[offset]) || ('\n' == buffer[offset]))
+            {
+                offset++;
+                continue;
+            }
+        }
+
+        const char* begin = buffer + offset;
+        std::size_t availableLength = bufferLength - offset;
+
+        if (0 == this->headLength)
+        {
+            const char* headEnd = findHeadEnd(begin + this->scannedLength, begin + availableLength);
+
+            if (nullptr == headEnd)
+            {
+                if (availableLength > this->maximumLength)
+                {
+                    throw Parser::Errors::OversizedRequest();
+                }
+
+                // NOTE: The last bytes may be the start of the empty line, so
+                // they are scanned again once more data arrives.
+                this->scannedLength = (availableLength > 3) ? availableLength - 3 : 0;
+
+                break;
+            }
+
+            this->headLength = headEnd - begin;
+            this->parseHead(begin, headEnd);
+
+            if (this->headLength + this->bodyLength > this->maximumLength)
+            {
+                throw Parser::Errors::OversizedRequest();
+            }
+        }
+
+        if (availableLength < this->headLength + this->bodyLength)
+        {
+            break;
+        }
+
+        // NOTE: The views are re-created if the head was parsed in an earlier
+        // call, since those pointed into a buffer that has since moved.
+        if (this->request.method.data() != begin)
+        {
+            this->parseHead(begin, begin + this->headLength);
+        }
+
+        this->request.body = std::string_view(begin + this->headLength, this->bodyLength);
+
+        handleRequest(this->request);
+
+        offset += this->headLength + this->bodyLength;
+
+        this->scannedLength = 0;
+        this->headLength = 0;
+        this->bodyLength = 0;
+        this->request.method = {};
+    }
+
+    return offset;
+}
+
+void Parser::parseHead(const char* head, const char* headEnd)
+{
+    this->request.headers.clear();
+
+    const char* lineEnd = findByte(head, headEnd, '\n');
+    std::string_view line = trimLine(head, lineEnd);
+
+    std::size_t methodEnd = findIn(line, ' ');
+    std::size_t targetEnd = findIn(line, ' ', methodEnd + 1);
+
+    if (
+        (std::string_view::npos == methodEnd) ||
+        (std::string_view::npos == targetEnd) ||
+        (0 == methodEnd) ||
+        (methodEnd + 1 == targetEnd)
+    )
+    {
+        throw Parser::Errors::MalformedRequest();
+    }
+
+    std::string_view version = line.substr(targetEnd + 1);
+
+    if ("HTTP/1.1" == version)
+    {
+        this->request.versionMinor = 1;
+    }
+    else if ("HTTP/1.0" == version)
+    {
+        this->request.versionMinor = 0;
+    }
+    else
+    {
+        throw Parser::Errors::MalformedRequest();
+    }
+
+    this->request.method = line.substr(0, methodEnd);
+    this->request.target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+
+    for (const char* cursor = lineEnd + 1; cursor < headEnd; cursor = lineEnd + 1)
+    {
+        lineEnd = findByte(cursor, headEnd, '\n');
+        line = trimLine(cursor, lineEnd);
+
+        if (line.empty())
+        {
+            break;
+        }
+
+        // NOTE: A line starting with whitespace continues the previous one
+        // (obsolete line folding). Proxies that unfold it and proxies that do
+        // not would see different headers, so it is rejected (RFC 9112,
+        // section 5.2).
+        if ((' ' == line[0]) || ('\t' == line[0]))
+        {
+            throw Parser::Errors::MalformedRequest();
+        }
+
+        std::size_t colon = findIn(line, ':');
+
+        // NOTE: Whitespace between the name and the colon is forbidden, since
+        // proxies may disagree on how to interpret it (RFC 9112, section 5.1).
+        if (
+            (std::string_view::npos == colon) ||
+            (0 == colon) ||
+            (' ' == line[colon - 1]) ||
+            ('\t' == line[colon - 1])
+        )
+        {
+            throw Parser::Errors::MalformedRequest();
+        }
+
+        this->request.headers.push_back(Header {
+            line.substr(0, colon),
+            trimSpaces(line.substr(colon + 1)),
+        });
+    }
+
+    bool hasContentLength = false;
+
+    this->bodyLength = 0;
+    this->request.keepAlive = (1 == this->request.versionMinor);
+
+    for (const Header& header : this->request.headers)
+    {
+        if (equalsIgnoringCase(header.name, "Content-Length"))
+        {
+            std::size_t length = 0;
+
+            if (header.value.empty())
+            {
+                throw Parser::Errors::MalformedRequest();
+            }
+
+            for (char digit : header.value)
+            {
+                if (('0' > digit) || ('9' < digit))
+                {
+                    throw Parser::Errors::MalformedRequest();
+                }
+
+                // NOTE: Checked before overflowing, since any length past the
+                // maximum is rejected as too large anyway.
+                if (length > this->maximumLength)
+                {
+                    throw Parser::Errors::OversizedRequest();
+                }
+
+                length = length * 10 + (digit - '0');
+            }
+
+            if (hasContentLength && (length != this->bodyLength))
+            {
+                throw Parser::Errors::MalformedRequest();
+            }
+
+            hasContentLength = true;
+            this->bodyLength = length;
+        }
+        else if (equalsIgnoringCase(header.name, "Transfer-Encoding"))
+        {
+            throw Parser::Errors::UnsupportedEncoding();
+        }
+        else if (equalsIgnoringCase(header.name, "Connection"))
+        {
+            if (containsToken(header.value, "close"))
+            {
+                this->request.keepAlive = false;
+            }
+            else if (containsToken(header.value, "keep-alive"))
+            {
+                this->request.keepAlive = true;
+            }
+        }
+    }
+}
+
+void Writer::write(
+    Server* server,
+    Server::Socket osPeerSocket,
+    const Request& request,
+    unsigned int status,
+    std::string_view reason,
+    const std::vector<Header>& headers,
+    std::string_view body
+)
+{
+    this->closingConnection = !request.keepAlive;
+
+    // NOTE: The buffer is reused between responses, so after the first few
+    // this does not allocate.
+    this->buffer.clear();
+
+    this->buffer.append("HTTP/1.1 ");
+    this->buffer.append(std::to_string(status));
+    this->buffer.append(" ");
+    this->buffer.append(reason);
+    this->buffer.append("\r\n");
+
+    for (const Header& header : headers)
+    {
+        this->buffer.append(header.name);
+        this->buffer.append(": ");
+        this->buffer.append(header.value);
+        this->buffer.append("\r\n");
+    }
+
+    this->buffer.append("Content-Length: ");
+    this->buffer.append(std::to_string(body.size()));
+    this->buffer.append("\r\n");
+
+    this->buffer.append(this->closingConnection ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
+    this->buffer.append("\r\n");
+    this->buffer.append(body);
+
+    server->send(osPeerSocket, this->buffer.data(), this->buffer.size());
+}
+
+bool Writer::closing() const
+{
+    return this->closingConnection;
+}
+
+selx::Server::Handlers selx::http::serve(Handlers handlers, std::size_t maximumLength)
+{
+    struct Session {
+        Parser      parser;
+        Writer      writer;
+    };
+
+    auto sessions = std::make_shared<
+        std::unordered_map<Server::Socket, std::shared_ptr<Session>>
+    >();
+
+    // NOTE: Assigned by name, since each backend declares its own handlers
+    // and they only have to agree on these three.
+    Server::Handlers serverHandlers = {};
+
+    serverHandlers.handlePeerConnection = [handlers, sessions, maximumLength](Server* server, Server::Socket osPeerSocket)
+    {
+        (*sessions)[osPeerSocket] = std::make_shared<Session>(Session {
+            Parser(maximumLength),
+            Writer(),
+        });
+
+        if (handlers.handlePeerConnection)
+        {
+            handlers.handlePeerConnection(server, osPeerSocket);
+        }
+    };
+
+    serverHandlers.handlePeerDisconnection = [handlers, sessions](Server* server, Server::Socket osPeerSocket)
+    {
+        sessions->erase(osPeerSocket);
+
+        if (handlers.handlePeerDisconnection)
+        {
+            handlers.handlePeerDisconnection(server, osPeerSocket);
+        }
+    };
+
+    serverHandlers.handleDataArrival = [handlers, sessions, maximumLength](Server* server, Server::Socket osPeerSocket, char* buffer, std::size_t bufferLength)
+    {
+        std::shared_ptr<Session>& slot = (*sessions)[osPeerSocket];
+
+        // Peers attached from another server never went through the
+        // connection handler, so they get their session here.
+        if (!slot)
+        {
+            slot = std::make_shared<Session>(Session {
+                Parser(maximumLength),
+                Writer(),
+            });
+        }
+
+        // NOTE: Keeps the session alive even if the handler kicks the
+        // peer while its requests are still being parsed.
+        std::shared_ptr<Session> session = slot;
+
+        auto fail = [&](unsigned int status, std::string_view reason)
+        {
+            if (0 == sessions->count(osPeerSocket))
+            {
+                return;
+            }
+
+            Request request = {};
+
+            request.keepAlive = false;
+            session->writer.write(server, osPeerSocket, request, status, reason, {}, {});
+        };
+
+        try
+        {
+            session->parser.feed(buffer, bufferLength, [&](const Request& request)
+            {
+                if (session->writer.closing() || (0 == sessions->count(osPeerSocket)))
+                {
+                    return;
+                }
+
+                handlers.handleRequest(server, osPeerSocket, request, session->writer);
+            });
+        }
+        catch (const Parser::Errors::MalformedRequest&)
+        {
+            fail(400, "Bad Request");
+        }
+        catch (const Parser::Errors::OversizedRequest&)
+        {
+            fail(413, "Content Too Large");
+        }
+        catch (const Parser::Errors::UnsupportedEncoding&)
+        {
+            fail(501, "Not Implemented");
+        }
+
+        if (session->writer.closing() && (0 != sessions->count(osPeerSocket)))
+        {
+            server->kick(osPeerSocket);
+        }
+    };
+
+#if defined(SELX_EPOLL_HPP)
+    // The session holds input already read from the socket (e.g. the start
+    // of a body), so it must follow the peer to its new server.
+    serverHandlers.handlePeerDetachment = [sessions](Server*, Server::Socket osPeerSocket)
+    {
+        std::shared_ptr<void> payload = {};
+        auto iterator = sessions->find(osPeerSocket);
+
+        if (std::end(*sessions) != iterator)
+        {
+            payload = iterator->second;
+            sessions->erase(iterator);
+        }
+
+        return payload;
+    };
+
+    serverHandlers.handlePeerAttachment = [sessions](Server*, Server::Socket osPeerSocket, std::shared_ptr<void> payload)
+    {
+        if (payload)
+        {
+            (*sessions)[osPeerSocket] = std::static_pointer_cast<Session>(payload);
+        }
+    };
+#endif
+
+    return serverHandlers;
+}
@@ -0,0 +1,136 @@
+#ifndef SELX_HTTP_HPP
+#define SELX_HTTP_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "selx.hpp"
+
+namespace selx::http {
+
+    struct Header {
+        std::string_view    name;
+        std::string_view    value;
+    };
+
+    // Every view points either into the buffer handed to `handleDataArrival`
+    // or into the parser's own buffer, so they are only valid while the
+    // request is being handled.
+    struct Request {
+        std::string_view        method;
+        std::string_view        target;
+        int                     versionMinor;
+        std::vector<Header>     headers;
+        std::string_view        body;
+        bool                    keepAlive;
+
+        // Case-insensitive lookup. Returns an empty view if the header is
+        // missing.
+        std::string_view header(std::string_view name) const;
+    };
+
+    // Implementations of the byte scanning every parser relies on.
+    enum class Scanner {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    // Makes every parser scan with the given implementation, returning
+    // whether this build and CPU support it. Parsers start with the fastest
+    // one, so this is only meant to compare them (e.g. in benchmarks). Not
+    // thread-safe.
+    bool useScanner(Scanner scanner);
+
+    class Parser {
+
+        public:
+
+            class Errors {
+
+                public:
+
+                    class MalformedRequest : std::exception {};
+                    class OversizedRequest : std::exception {};
+                    class UnsupportedEncoding : std::exception {};
+
+                    Errors() = delete;
+                    ~Errors() = delete;
+
+            };
+
+            Parser(std::size_t maximumLength = 65536);
+
+            // Parses every complete request found in the buffer, calling the
+            // handler once per request, in order. Bytes belonging to an
+            // unfinished request are kept until the next call.
+            void feed(
+                char* buffer,
+                std::size_t bufferLength,
+                const std::function<void(const Request&)>& handleRequest
+            );
+
+        private:
+
+            std::size_t         maximumLength;
+            std::vector<char>   pending;
+            std::size_t         scannedLength;
+            std::size_t         headLength;
+            std::size_t         bodyLength;
+            Request             request;
+
+            std::size_t consume(
+                char* buffer,
+                std::size_t bufferLength,
+                const std::function<void(const Request&)>& handleRequest
+            );
+            void parseHead(const char* head, const char* headEnd);
+
+    };
+
+    class Writer {
+
+        public:
+
+            Writer() = default;
+
+            // Sends the whole response with a single call, adding the
+            // `Content-Length` and `Connection` headers.
+            void write(
+                Server* server,
+                Server::Socket osPeerSocket,
+                const Request& request,
+                unsigned int status,
+                std::string_view reason,
+                const std::vector<Header>& headers,
+                std::string_view body
+            );
+
+            // Whether the last response announced `Connection: close`.
+            bool closing() const;
+
+        private:
+
+            std::string     buffer;
+            bool            closingConnection = false;
+
+    };
+
+    struct Handlers {
+        std::function<void(Server*, Server::Socket)>                            	handlePeerConnection;
+        std::function<void(Server*, Server::Socket)>                            	handlePeerDisconnection;
+        std::function<void(Server*, Server::Socket, const Request&, Writer&)>  	handleRequest;
+    };
+
+    // Builds server handlers which keep a parser per peer. Malformed requests
+    // are answered with an error status, and peers are kicked once a response
+    // closes the connection. The handlers are not thread-safe, so every
+    // server needs its own. With epoll, the parser moves along with peers
+    // detached outside of `handleRequest`.
+    Server::Handlers serve(Handlers handlers, std::size_t maximumLength = 65536);
+
+}
+
+#endif // SELX_HTTP_HPP
@@ -0,0 +1,669 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "replay.hpp"
+
+using namespace selx::replay;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const char TRACE_MAGIC[8] = { 's', 'e', 'l', 'x', 't', 'r', 'c', '1' };
+
+    // Give up waiting for the server once it has not observed anything for
+    // this long (e.g. because it dropped a peer without reading it).
+    const std::chrono::seconds DRAIN_TIMEOUT(1);
+
+    template <typename Integer>
+    void writeInteger(std::ostream& stream, Integer value)
+    {
+        // NOTE: Always little-endian, so traces can be moved across machines.
+        for (std::size_t i = 0; i < sizeof(Integer); i++)
+        {
+            stream.put((char) ((value >> (i * 8)) & 0xFF));
+        }
+    }
+
+    template <typename Integer>
+    Integer readInteger(std::istream& stream)
+    {
+        Integer value = 0;
+
+        for (std::size_t i = 0; i < sizeof(Integer); i++)
+        {
+            int byte = stream.get();
+
+            if (std::istream::traits_type::eof() == byte)
+            {
+                throw Trace::Errors::MalformedTrace();
+            }
+
+            value |= ((Integer) (unsigned char) byte) << (i * 8);
+        }
+
+        return value;
+    }
+
+    double percentile(std::vector<double>& samples, double fraction)
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+
+        std::size_t index = (std::size_t) (fraction * (double) (samples.size() - 1));
+
+        std::nth_element(std::begin(samples), std::begin(samples) + index, std::end(samples));
+
+        return samples[index];
+    }
+
+}
+
+void Trace::save(std::ostream& stream) const
+{
+    stream.write(&TRACE_MAGIC[0], sizeof(TRACE_MAGIC));
+
+    writeInteger<std::uint64_t>(stream, this->events.size());
+
+    for (const Event& event : this->events)
+    {
+        writeInteger<std::uint8_t>(stream, (std::uint8_t) event.kind);
+        writeInteger<std::uint64_t>(stream, event.time);
+        writeInteger<std::uint32_t>(stream, event.peer);
+        writeInteger<std::uint32_t>(stream, event.data.size());
+
+        stream.write(event.data.data(), event.data.size());
+    }
+}
+
+Trace Trace::load(std::istream& stream)
+{
+    char magic[sizeof(TRACE_MAGIC)] = {};
+
+    if (
+        (!stream.read(&magic[0], sizeof(magic))) ||
+        (!std::equal(std::begin(magic), std::end(magic), std::begin(TRACE_MAGIC)))
+    )
+    {
+        throw Trace::Errors::MalformedTrace();
+    }
+
+    Trace trace = {};
+    std::uint64_t eventsCount = readInteger<std::uint64_t>(stream);
+
+    for (std::uint64_t i = 0; i < eventsCount; i++)
+    {
+        Event event = {};
+        std::uint8_t kind = readInteger<std::uint8_t>(stream);
+
+        if (kind > (std::uint8_t) Event::Kind::Phase)
+        {
+            throw Trace::Errors::MalformedTrace();
+        }
+
+        event.kind = (Event::Kind) kind;
+        event.time = readInteger<std::uint64_t>(stream);
+        event.peer = readInteger<std::uint32_t>(stream);
+        event.data.resize(readInteger<std::uint32_t>(stream));
+
+        if (!stream.read(&event.data[0], event.data.size()))
+        {
+            throw Trace::Errors::MalformedTrace();
+        }
+
+        trace.events.push_back(std::move(event));
+    }
+
+    return trace;
+}
+
+struct Recorder::State {
+    Trace                                               trace;
+    Clock::time_point                                   start;
+    std::unordered_map<Server::Socket, std::uint32_t>   peers;
+    std::uint32_t                                       nextPeer;
+
+    void record(Event::Kind kind, std::uint32_t peer, std::string data)
+    {
+        std::uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - this->start
+        ).count();
+
+        this->trace.events.push_back(Event { kind, time, peer, std::move(data) });
+    }
+};
+
+Recorder::Recorder()
+{
+    this->state = std::make_shared<Recorder::State>();
+    this->state->start = Clock::now();
+    this->state->nextPeer = 0;
+}
+
+selx::Server::Handlers Recorder::wrap(Server::Handlers handlers)
+{
+    std::shared_ptr<Recorder::State> state = this->state;
+
+    return Server::Handlers {
+        [handlers, state](Server* server, Server::Socket osPeerSocket)
+        {
+            std::uint32_t peer = state->nextPeer++;
+
+            state->peers[osPeerSocket] = peer;
+            state->record(Event::Kind::Connection, peer, {});
+
+            handlers.handlePeerConnection(server, osPeerSocket);
+        },
+        [handlers, state](Server* server, Server::Socket osPeerSocket)
+        {
+            auto iterator = state->peers.find(osPeerSocket);
+
+            if (std::end(state->peers) != iterator)
+            {
+                state->record(Event::Kind::Disconnection, iterator->second, {});
+                state->peers.erase(iterator);
+            }
+
+            handlers.handlePeerDisconnection(server, osPeerSocket);
+        },
+        [handlers, state](Server* server, Server::Socket osPeerSocket, char* buffer, std::size_t bufferLength)
+        {
+            auto iterator = state->peers.find(osPeerSocket);
+
+            // NOTE: Recorded before forwarding, since handlers are allowed to
+            // modify the buffer.
+            if (std::end(state->peers) != iterator)
+            {
+                state->record(Event::Kind::Data, iterator->second, std::string(buffer, bufferLength));
+            }
+
+            handlers.handleDataArrival(server, osPeerSocket, buffer, bufferLength);
+        },
+        handlers.handlePeerDetachment,
+        handlers.handlePeerAttachment,
+    };
+}
+
+void Recorder::mark(std::string name)
+{
+    this->state->record(Event::Kind::Phase, 0, std::move(name));
+}
+
+const Trace& Recorder::trace() const
+{
+    return this->state->trace;
+}
+
+struct Player::State {
+
+    struct Delivery {
+        std::uint64_t       sentLength;
+        Clock::time_point   sentAt;
+        std::size_t         phase;
+    };
+
+    struct Client {
+        int                     osSocket;
+        bool                    gone;
+        bool                    accepted;
+        Clock::time_point       connectedAt;
+        std::size_t             connectedPhase;
+        bool                    closing;
+        Clock::time_point       closedAt;
+        std::size_t             closedPhase;
+        std::uint64_t           sentLength;
+        std::uint64_t           receivedLength;
+        std::deque<Delivery>    deliveries;
+    };
+
+    struct Statistics {
+        std::string             name;
+        Clock::time_point       start;
+        Clock::time_point       end;
+        std::size_t             connections;
+        std::size_t             fragments;
+        std::size_t             disconnections;
+        std::size_t             bytes;
+        std::vector<double>     latencies;
+    };
+
+    Trace                                               trace;
+    Transport                                           transport;
+    Speed                                               speed;
+    std::uint16_t                                       port;
+
+    std::unordered_map<std::uint32_t, Client>           clients;
+    std::unordered_map<Server::Socket, std::uint32_t>   osServerSockets;
+    std::unordered_map<std::uint16_t, std::uint32_t>    connectingPorts;
+    std::uint32_t                                       adoptingPeer;
+    std::size_t                                         outstandingCount;
+    Clock::time_point                                   lastObservation;
+    std::vector<Statistics>                             phases;
+
+    void observe(std::size_t phase, Clock::time_point issuedAt)
+    {
+        Clock::time_point now = Clock::now();
+
+        this->phases[phase].latencies.push_back(
+            std::chrono::duration<double, std::micro>(now - issuedAt).count()
+        );
+        this->phases[phase].end = std::max(this->phases[phase].end, now);
+
+        this->outstandingCount--;
+        this->lastObservation = now;
+    }
+
+    // Gives up on a client the server dropped without calling any handler
+    // (e.g. one rejected at admission), so that nothing waits for it.
+    void lose(std::uint32_t peer)
+    {
+        Client& client = this->clients[peer];
+
+        if (!client.accepted)
+        {
+            client.accepted = true;
+            this->outstandingCount--;
+
+            auto iterator = std::find_if(
+                std::begin(this->connectingPorts),
+                std::end(this->connectingPorts),
+                [peer](const auto& entry) { return peer == entry.second; }
+            );
+
+            if (std::end(this->connectingPorts) != iterator)
+            {
+                this->connectingPorts.erase(iterator);
+            }
+        }
+
+        client.gone = true;
+
+        this->outstandingCount -= client.deliveries.size();
+        client.deliveries.clear();
+    }
+
+    void startPhase(std::string name)
+    {
+        Clock::time_point now = Clock::now();
+
+        if (!this->phases.empty())
+        {
+            this->phases.back().end = std::max(this->phases.back().end, now);
+        }
+
+        this->phases.push_back(Statistics { std::move(name), now, now, 0, 0, 0, 0, {} });
+    }
+
+    void connect(Server& server, std::uint32_t peer)
+    {
+        Client& client = this->clients[peer];
+
+        client = Client {};
+        client.osSocket = -1;
+        client.connectedAt = Clock::now();
+        client.connectedPhase = this->phases.size() - 1;
+
+        this->outstandingCount++;
+        this->phases.back().connections++;
+
+        if (Transport::SocketPair == this->transport)
+        {
+            int osSockets[2] = {};
+
+            if (-1 == ::socketpair(AF_UNIX, SOCK_STREAM, 0, &osSockets[0]))
+            {
+                throw Player::Errors::OpenSocket();
+            }
+
+            if (-1 == ::fcntl(osSockets[0], F_SETFL, O_NONBLOCK))
+            {
+                throw Player::Errors::OpenSocket();
+            }
+
+            client.osSocket = osSockets[0];
+
+            // NOTE: Adopting runs the connection handler right away, which
+            // needs to know which client the new peer belongs to.
+            this->adoptingPeer = peer;
+
+            server.adopt(osSockets[1]);
+        }
+        else
+        {
+            client.osSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+            if (-1 == client.osSocket)
+            {
+                throw Player::Errors::OpenSocket();
+            }
+
+            // NOTE: Non-blocking, since a full backlog would otherwise block
+            // the only thread that can accept.
+            if (-1 == ::fcntl(client.osSocket, F_SETFL, O_NONBLOCK))
+            {
+                throw Player::Errors::OpenSocket();
+            }
+
+            sockaddr_in osAddress = {};
+
+            osAddress.sin_family = AF_INET;
+            osAddress.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+            osAddress.sin_port = ::htons(this->port);
+
+            if (
+                (-1 == ::connect(client.osSocket, (sockaddr*) &osAddress, sizeof(osAddress))) &&
+                (EINPROGRESS != errno)
+            )
+            {
+                throw Player::Errors::ConnectSocket();
+            }
+
+            sockaddr_in osLocalAddress = {};
+            socklen_t osLocalAddressLength = sizeof(osLocalAddress);
+
+            if (-1 == ::getsockname(client.osSocket, (sockaddr*) &osLocalAddress, &osLocalAddressLength))
+            {
+                throw Player::Errors::ConnectSocket();
+            }
+
+            this->connectingPorts[::ntohs(osLocalAddress.sin_port)] = peer;
+        }
+    }
+
+    void send(Server& server, std::uint32_t peer, const std::string& data)
+    {
+        Client& client = this->clients[peer];
+
+        if (client.gone)
+        {
+            return;
+        }
+
+        client.sentLength += data.size();
+        client.deliveries.push_back(Delivery {
+            client.sentLength, Clock::now(), this->phases.size() - 1
+        });
+
+        this->outstandingCount++;
+        this->phases.back().fragments++;
+        this->phases.back().bytes += data.size();
+
+        std::size_t offset = 0;
+
+        while (offset < data.size())
+        {
+            ssize_t length = ::send(
+                client.osSocket, data.data() + offset, data.size() - offset, MSG_NOSIGNAL
+            );
+
+            if (-1 != length)
+            {
+                offset += length;
+            }
+            else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            {
+                // The server is not keeping up (or has not accepted yet), so
+                // let it drain the socket.
+                server.poll();
+
+                if (client.gone)
+                {
+                    return;
+                }
+            }
+            else if ((ECONNRESET == errno) || (EPIPE == errno))
+            {
+                this->lose(peer);
+
+                return;
+            }
+            else
+            {
+                throw Player::Errors::WriteSocket();
+            }
+        }
+    }
+
+    void disconnect(std::uint32_t peer)
+    {
+        Client& client = this->clients[peer];
+        int osError = 0;
+        socklen_t osErrorLength = sizeof(osError);
+
+        // A client that never sent anything only learns about a reset here.
+        if (
+            (!client.gone) &&
+            (0 == ::getsockopt(client.osSocket, SOL_SOCKET, SO_ERROR, &osError, &osErrorLength)) &&
+            (ECONNRESET == osError)
+        )
+        {
+            this->lose(peer);
+        }
+
+        ::close(client.osSocket);
+
+        client.osSocket = -1;
+        this->phases.back().disconnections++;
+
+        if (!client.gone)
+        {
+            client.closing = true;
+            client.closedAt = Clock::now();
+            client.closedPhase = this->phases.size() - 1;
+
+            this->outstandingCount++;
+        }
+    }
+
+};
+
+Player::Player(Trace trace, Transport transport, Speed speed, std::uint16_t port)
+{
+    this->state = std::make_shared<Player::State>();
+    this->state->trace = std::move(trace);
+    this->state->transport = transport;
+    this->state->speed = speed;
+    this->state->port = port;
+}
+
+selx::Server::Handlers Player::wrap(Server::Handlers handlers)
+{
+    std::shared_ptr<Player::State> state = this->state;
+
+    return Server::Handlers {
+        [handlers, state](Server* server, Server::Socket osPeerSocket)
+        {
+            std::uint32_t peer = state->adoptingPeer;
+
+            if (Transport::Loopback == state->transport)
+            {
+                sockaddr_storage osAddress = {};
+                socklen_t osAddressLength = sizeof(osAddress);
+                std::uint16_t port = 0;
+
+                ::getpeername(osPeerSocket, (sockaddr*) &osAddress, &osAddressLength);
+
+                if (AF_INET == osAddress.ss_family)
+                {
+                    port = ::ntohs(((sockaddr_in*) &osAddress)->sin_port);
+                }
+                else if (AF_INET6 == osAddress.ss_family)
+                {
+                    port = ::ntohs(((sockaddr_in6*) &osAddress)->sin6_port);
+                }
+
+                auto iterator = state->connectingPorts.find(port);
+
+                // Not one of ours (e.g. a live client), so it is just
+                // forwarded.
+                if (std::end(state->connectingPorts) == iterator)
+                {
+                    handlers.handlePeerConnection(server, osPeerSocket);
+                    return;
+                }
+
+                peer = iterator->second;
+                state->connectingPorts.erase(iterator);
+            }
+
+            Player::State::Client& client = state->clients[peer];
+
+            client.accepted = true;
+
+            state->osServerSockets[osPeerSocket] = peer;
+            state->observe(client.connectedPhase, client.connectedAt);
+
+            handlers.handlePeerConnection(server, osPeerSocket);
+        },
+        [handlers, state](Server* server, Server::Socket osPeerSocket)
+        {
+            auto iterator = state->osServerSockets.find(osPeerSocket);
+
+            if (std::end(state->osServerSockets) != iterator)
+            {
+                Player::State::Client& client = state->clients[iterator->second];
+
+                client.gone = true;
+
+                // NOTE: Data the server never read (e.g. because it kicked
+                // the peer) cannot be observed anymore.
+                state->outstandingCount -= client.deliveries.size();
+                client.deliveries.clear();
+
+                if (client.closing)
+                {
+                    client.closing = false;
+                    state->observe(client.closedPhase, client.closedAt);
+                }
+
+                state->osServerSockets.erase(iterator);
+            }
+
+            handlers.handlePeerDisconnection(server, osPeerSocket);
+        },
+        [handlers, state](Server* server, Server::Socket osPeerSocket, char* buffer, std::size_t bufferLength)
+        {
+            auto iterator = state->osServerSockets.find(osPeerSocket);
+
+            if (std::end(state->osServerSockets) != iterator)
+            {
+                Player::State::Client& client = state->clients[iterator->second];
+
+                client.receivedLength += bufferLength;
+
+                while (
+                    (!client.deliveries.empty()) &&
+                    (client.deliveries.front().sentLength <= client.receivedLength)
+                )
+                {
+                    state->observe(client.deliveries.front().phase, client.deliveries.front().sentAt);
+                    client.deliveries.pop_front();
+                }
+            }
+
+            handlers.handleDataArrival(server, osPeerSocket, buffer, bufferLength);
+        },
+        handlers.handlePeerDetachment,
+        handlers.handlePeerAttachment,
+    };
+}
+
+Report Player::play(Server& server)
+{
+    Player::State& state = *this->state;
+
+    state.clients = {};
+    state.osServerSockets = {};
+    state.connectingPorts = {};
+    state.outstandingCount = 0;
+    state.phases = {};
+
+    Clock::time_point start = Clock::now();
+
+    if (state.trace.events.empty() || (Event::Kind::Phase != state.trace.events.front().kind))
+    {
+        state.startPhase("default");
+    }
+
+    for (const Event& event : state.trace.events)
+    {
+        if (Speed::Realtime == state.speed)
+        {
+            Clock::time_point due = start + std::chrono::nanoseconds(event.time);
+
+            while (Clock::now() < due)
+            {
+                server.poll();
+            }
+        }
+
+        if (Event::Kind::Phase == event.kind)
+        {
+            state.startPhase(event.data);
+        }
+        else if (Event::Kind::Connection == event.kind)
+        {
+            state.connect(server, event.peer);
+        }
+        else if (Event::Kind::Data == event.kind)
+        {
+            state.send(server, event.peer, event.data);
+        }
+        else
+        {
+            state.disconnect(event.peer);
+        }
+
+        server.poll();
+
+        state.phases.back().end = std::max(state.phases.back().end, Clock::now());
+    }
+
+    state.lastObservation = Clock::now();
+
+    while ((0 < state.outstandingCount) && (Clock::now() - state.lastObservation < DRAIN_TIMEOUT))
+    {
+        server.poll();
+    }
+
+    for (auto& [peer, client] : state.clients)
+    {
+        if (-1 != client.osSocket)
+        {
+            ::close(client.osSocket);
+        }
+    }
+
+    Report report = {};
+
+    for (Player::State::Statistics& statistics : state.phases)
+    {
+        double seconds = std::chrono::duration<double>(statistics.end - statistics.start).count();
+        std::size_t eventsCount = statistics.connections + statistics.fragments + statistics.disconnections;
+
+        report.phases.push_back(Phase {
+            statistics.name,
+            seconds,
+            statistics.connections,
+            statistics.fragments,
+            statistics.disconnections,
+            statistics.bytes,
+            (0.0 < seconds) ? (double) statistics.bytes / seconds : 0.0,
+            (0.0 < seconds) ? (double) eventsCount / seconds : 0.0,
+            percentile(statistics.latencies, 0.5),
+            percentile(statistics.latencies, 0.99),
+            percentile(statistics.latencies, 1.0),
+        });
+    }
+
+    return report;
+}
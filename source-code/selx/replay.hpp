@@ -0,0 +1,150 @@
+#ifndef SELX_REPLAY_HPP
+#define SELX_REPLAY_HPP
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "selx.hpp"
+
+namespace selx::replay {
+
+    struct Event {
+
+        enum class Kind : std::uint8_t {
+            Connection,
+            Data,
+            Disconnection,
+            Phase,
+        };
+
+        Kind            kind;
+        // Nanoseconds since the recording started.
+        std::uint64_t   time;
+        // Sequential connection number. Descriptors are reused by the OS, so
+        // they cannot identify a connection across the whole trace.
+        std::uint32_t   peer;
+        // Received bytes for `Data` events, and the phase name for `Phase`
+        // events.
+        std::string     data;
+
+    };
+
+    struct Trace {
+
+        class Errors {
+
+            public:
+
+                class MalformedTrace : std::exception {};
+
+                Errors() = delete;
+                ~Errors() = delete;
+
+        };
+
+        std::vector<Event>  events;
+
+        void save(std::ostream& stream) const;
+        Trace static load(std::istream& stream);
+
+    };
+
+    class Recorder {
+
+        public:
+
+            Recorder();
+
+            // Builds handlers that record every event dispatched by `poll`
+            // before forwarding it to the given ones.
+            Server::Handlers wrap(Server::Handlers handlers);
+
+            // Starts a new phase. Replays report every phase separately.
+            void mark(std::string name);
+
+            const Trace& trace() const;
+
+        private:
+
+            struct State;
+
+            std::shared_ptr<State>  state;
+
+    };
+
+    struct Phase {
+        std::string     name;
+        double          seconds;
+        std::size_t     connections;
+        std::size_t     fragments;
+        std::size_t     disconnections;
+        std::size_t     bytes;
+        double          bytesPerSecond;
+        double          eventsPerSecond;
+        // Microseconds between a client action and the server handler
+        // observing it.
+        double          latencyMedian;
+        double          latency99;
+        double          latencyMaximum;
+    };
+
+    struct Report {
+        std::vector<Phase>  phases;
+    };
+
+    class Player {
+
+        public:
+
+            enum class Transport {
+                // Clients connect to `127.0.0.1` on the given port, so the
+                // server must listen on it.
+                Loopback,
+                // Clients are `socketpair` ends adopted by the server.
+                SocketPair,
+            };
+
+            enum class Speed {
+                // Events are spaced as they were recorded.
+                Realtime,
+                // Events are issued as soon as possible.
+                Maximum,
+            };
+
+            class Errors {
+
+                public:
+
+                    class OpenSocket : std::exception {};
+                    class ConnectSocket : std::exception {};
+                    class WriteSocket : std::exception {};
+
+                    Errors() = delete;
+                    ~Errors() = delete;
+
+            };
+
+            Player(Trace trace, Transport transport, Speed speed, std::uint16_t port = 0);
+
+            // Builds handlers that observe when the server receives each
+            // replayed event. The server passed to `play` must use them.
+            Server::Handlers wrap(Server::Handlers handlers);
+
+            // Replays the whole trace, polling the server in between events,
+            // and waits for the server to observe every event.
+            Report play(Server& server);
+
+        private:
+
+            struct State;
+
+            std::shared_ptr<State>  state;
+
+    };
+
+}
+
+#endif // SELX_REPLAY_HPP
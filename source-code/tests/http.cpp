@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <selx/http.hpp>
+
+using namespace selx::http;
+
+namespace {
+
+    // What a test keeps of each request, since the parser's views do not
+    // outlive the handler.
+    struct Parsed {
+        std::string     method;
+        std::string     target;
+        std::string     host;
+        std::string     body;
+        bool            keepAlive;
+    };
+
+    enum class Outcome {
+        Parsed,
+        Malformed,
+        Oversized,
+        Unsupported,
+    };
+
+    std::size_t failuresCount = 0;
+
+    void check(bool condition, const char* name)
+    {
+        if (!condition)
+        {
+            std::printf("FAILED: %s\n", name);
+            failuresCount++;
+        }
+    }
+
+    // Feeds `buffer` to a fresh parser in slices of `sliceLength` bytes.
+    Outcome parse(std::string buffer, std::size_t sliceLength, std::vector<Parsed>& requests)
+    {
+        Parser parser(65536);
+
+        auto handleRequest = [&](const Request& request)
+        {
+            requests.push_back(Parsed {
+                std::string(request.method),
+                std::string(request.target),
+                std::string(request.header("host")),
+                std::string(request.body),
+                request.keepAlive,
+            });
+        };
+
+        try
+        {
+            for (std::size_t offset = 0; offset < buffer.size(); offset += sliceLength)
+            {
+                std::size_t length = std::min(sliceLength, buffer.size() - offset);
+
+                parser.feed(&buffer[offset], length, handleRequest);
+            }
+        }
+        catch (const Parser::Errors::MalformedRequest&)
+        {
+            return Outcome::Malformed;
+        }
+        catch (const Parser::Errors::OversizedRequest&)
+        {
+            return Outcome::Oversized;
+        }
+        catch (const Parser::Errors::UnsupportedEncoding&)
+        {
+            return Outcome::Unsupported;
+        }
+
+        return Outcome::Parsed;
+    }
+
+    Outcome parse(std::string buffer)
+    {
+        std::vector<Parsed> requests = {};
+
+        return parse(buffer, buffer.size(), requests);
+    }
+
+    void testWhole()
+    {
+        std::vector<Parsed> requests = {};
+        std::string buffer =
+            "GET /index.html HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Connection: close\r\n"
+            "\r\n";
+
+        check(Outcome::Parsed == parse(buffer, buffer.size(), requests), "whole: parsed");
+        check(1 == requests.size(), "whole: one request");
+
+        if (1 == requests.size())
+        {
+            check("GET" == requests[0].method, "whole: method");
+            check("/index.html" == requests[0].target, "whole: target");
+            check("example.com" == requests[0].host, "whole: case-insensitive header");
+            check(!requests[0].keepAlive, "whole: connection close");
+        }
+    }
+
+    void testFragmented()
+    {
+        std::string buffer =
+            "POST /form HTTP/1.1\n"
+            "Host: example.com\n"
+            "Content-Length: 11\n"
+            "\n"
+            "hello world";
+
+        // Every split point, down to a single byte at a time.
+        for (std::size_t sliceLength = 1; sliceLength <= buffer.size(); sliceLength++)
+        {
+            std::vector<Parsed> requests = {};
+
+            check(Outcome::Parsed == parse(buffer, sliceLength, requests), "fragmented: parsed");
+            check(
+                (1 == requests.size()) && ("hello world" == requests[0].body),
+                "fragmented: body reassembled"
+            );
+        }
+    }
+
+    void testPipelined()
+    {
+        std::string buffer =
+            "POST /first HTTP/1.1\r\n"
+            "Content-Length: 3\r\n"
+            "\r\n"
+            "abc"
+            "GET /second HTTP/1.1\r\n"
+            "\r\n"
+            "GET /third HTTP/1.0\r\n"
+            "\r\n";
+
+        for (std::size_t sliceLength : { buffer.size(), (std::size_t) 7, (std::size_t) 1 })
+        {
+            std::vector<Parsed> requests = {};
+
+            check(Outcome::Parsed == parse(buffer, sliceLength, requests), "pipelined: parsed");
+            check(3 == requests.size(), "pipelined: three requests");
+
+            if (3 == requests.size())
+            {
+                check("/first" == requests[0].target, "pipelined: first in order");
+                check("abc" == requests[0].body, "pipelined: first body");
+                check("/second" == requests[1].target, "pipelined: second in order");
+                check(requests[1].keepAlive, "pipelined: HTTP/1.1 keeps alive");
+                check("/third" == requests[2].target, "pipelined: third in order");
+                check(!requests[2].keepAlive, "pipelined: HTTP/1.0 closes");
+            }
+        }
+    }
+
+    void testErrors()
+    {
+        check(
+            Outcome::Malformed == parse("GET / HTTP/1.1\r\nA: b\r\n Host: x\r\n\r\n"),
+            "errors: folded line (space)"
+        );
+        check(
+            Outcome::Malformed == parse("GET / HTTP/1.1\r\n\tHost: x\r\n\r\n"),
+            "errors: folded line (tab)"
+        );
+        check(
+            Outcome::Malformed == parse("GET / HTTP/1.1\r\nHost : x\r\n\r\n"),
+            "errors: whitespace before colon"
+        );
+        check(
+            Outcome::Malformed == parse("GET / HTTP/2.0\r\n\r\n"),
+            "errors: unknown version"
+        );
+        check(
+            Outcome::Malformed == parse("POST / HTTP/1.1\r\nContent-Length: 12x\r\n\r\n"),
+            "errors: non-numeric length"
+        );
+        check(
+            Outcome::Malformed == parse("POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"),
+            "errors: conflicting lengths"
+        );
+        check(
+            Outcome::Oversized == parse("POST / HTTP/1.1\r\nContent-Length: 70000\r\n\r\n"),
+            "errors: length over the maximum"
+        );
+        check(
+            Outcome::Oversized == parse("POST / HTTP/1.1\r\nContent-Length: 1000000\r\n\r\n"),
+            "errors: length far over the maximum"
+        );
+        check(
+            Outcome::Oversized == parse("GET / HTTP/1.1\r\nX: " + std::string(70000, 'x')),
+            "errors: unterminated head over the maximum"
+        );
+        check(
+            Outcome::Unsupported == parse("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"),
+            "errors: transfer encoding"
+        );
+    }
+
+}
+
+int main()
+{
+    // Every scanner this machine supports has to parse the same way.
+    for (Scanner scanner : { Scanner::Scalar, Scanner::SSE2, Scanner::AVX2 })
+    {
+        if (!useScanner(scanner))
+        {
+            continue;
+        }
+
+        testWhole();
+        testFragmented();
+        testPipelined();
+        testErrors();
+    }
+
+    std::printf("%zu failures\n", failuresCount);
+
+    return (0 == failuresCount) ? 0 : 1;
+}